@@ -40,4 +40,16 @@ vec2 AABB::getExtents()
 	return m_extents;
 }
 
+void AABB::writeState(SnapshotWriter& writer) const
+{
+	RigidBody::writeState(writer);
+	writer.write(m_extents);
+}
+
+void AABB::readState(SnapshotReader& reader)
+{
+	RigidBody::readState(reader);
+	reader.read(m_extents);
+}
+
 // --------------------- NOT USED IN SUBMISSION ----------------------- //
\ No newline at end of file
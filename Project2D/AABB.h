@@ -16,6 +16,9 @@ public:
     void fixedUpdate(vec2 gravity, float timeStep) override;
     void draw() override;
 
+    void writeState(SnapshotWriter& writer) const override;
+    void readState(SnapshotReader& reader) override;
+
     vector<vec2> getCorners() const;
     vec2 getExtents();
 
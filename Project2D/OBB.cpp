@@ -1,4 +1,5 @@
 #include "OBB.h"
+#include "PhysicsCounters.h"
 
 /// <summary>
 /// OBB has no default constructor, the custom constructor for OBB takes a position, width and height, orientation, linear and
@@ -32,8 +33,8 @@ void OBB::draw()
 {
 	vector<vec2> corners = getCorners();
 
-	aie::Gizmos::add2DTri(corners[0], corners[1], corners[3], m_colour);
-	aie::Gizmos::add2DTri(corners[0], corners[3], corners[2], m_colour);
+	vec2 tris[6] = { corners[0], corners[1], corners[3], corners[0], corners[3], corners[2] };
+	aie::Gizmos::add2DTris(tris, 2, m_colour);
 }
 
 /// <summary>
@@ -154,6 +155,7 @@ bool OBB::isInside(vec2 point)
 /// <returns></returns>
 vector<vec2> OBB::getCorners() const
 {
+	aie::Counters::increment(PhysicsCounters::get().cornerAllocations);
 	vector<vec2> corners (4);
 
 	corners[0] = m_position - m_localX * m_extents.x - m_localY * m_extents.y;
@@ -163,3 +165,23 @@ vector<vec2> OBB::getCorners() const
 
 	return corners;
 }
+
+/// <summary>
+/// writeState() extends the RigidBody snapshot state with the half-edge extents of the box.
+/// </summary>
+/// <param name="writer">The snapshot being written.</param>
+void OBB::writeState(SnapshotWriter& writer) const
+{
+	RigidBody::writeState(writer);
+	writer.write(m_extents);
+}
+
+/// <summary>
+/// readState() reads back the state written by writeState().
+/// </summary>
+/// <param name="reader">The snapshot being read.</param>
+void OBB::readState(SnapshotReader& reader)
+{
+	RigidBody::readState(reader);
+	reader.read(m_extents);
+}
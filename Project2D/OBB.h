@@ -18,6 +18,9 @@ public:
     void draw() override;
 
     bool isInside(vec2 point) override;
+
+    void writeState(SnapshotWriter& writer) const override;
+    void readState(SnapshotReader& reader) override;
     // Used for OBB2OBB collision detection
     bool checkOBBCorners(const OBB& obb, vec2& contact, int& numContacts, float& pen, vec2& edgeNormal);
 
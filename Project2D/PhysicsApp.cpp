@@ -7,6 +7,7 @@
 #include "AABB.h"
 #include "OBB.h"
 #include "Spring.h"
+#include "Counters.h"
 
 const float PhysicsApp::extents = 100;
 const float PhysicsApp::aspectRatio = 16.0f / 9.0f;
@@ -21,8 +22,9 @@ PhysicsApp::~PhysicsApp() {
 
 /// <summary>
 /// startup() is called once at the start of the application, and instantiates a new renderer
-/// and physics scene. The function then populates the physics scene with two OBB shapes, and one
-/// sphere, as well as four planes that act as borders of the scene.
+/// and physics scene. The function then populates the physics scene from the default scene file, or
+/// if it can't be loaded, with two OBB shapes, and one sphere, as well as four planes that act as
+/// borders of the scene.
 /// </summary>
 /// <returns></returns>
 bool PhysicsApp::startup() 
@@ -30,17 +32,33 @@ bool PhysicsApp::startup()
 	m_playerSpring = nullptr;
 	constexpr float pi = glm::pi<float>();
 
-	// increase the 2D line count to maximize the number of objects we can draw
-	aie::Gizmos::create(255U, 255U, 65535U, 65535U);
+	// only 2D gizmos are drawn, the buffers grow if a busy scene needs more
+	aie::Gizmos::create(0U, 0U, 256U, 256U, 64U);
 
 	m_2dRenderer = new aie::Renderer2D();
 
 	m_font = new aie::Font("./font/consolas.ttf", 32);
+	m_quitText = m_2dRenderer->createStaticText(m_font, "Press ESC to quit!", 0, 720 - 64);
+	m_instructionText = m_2dRenderer->createStaticText(m_font, "Click and drag on shapes to pull them!", 50, 50);
 	
 	m_timer = 0;
+	m_divergedFrames = 0;
 
 	m_physicsScene = new PhysicsScene();
 
+	// Load the default scene, building the binary scene file from its text description the first time
+	SceneFile sceneFile;
+	if (!sceneFile.open("./scenes/default.scene") && SceneFile::convertText("./scenes/default.txt", "./scenes/default.scene"))
+	{
+		sceneFile.open("./scenes/default.scene");
+	}
+	if (sceneFile.isOpen())
+	{
+		m_physicsScene->addSceneFile(sceneFile);
+		return true;
+	}
+
+	// Otherwise fall back to the built in scene
 	// Sphere creation
 	m_physicsScene->addActor(new Sphere({ 0, 0 }, 0, { 5, 10 }, 1, 5, 25, 1, { 1, 0.5f, 1, 1 }));
 	 
@@ -62,9 +80,14 @@ bool PhysicsApp::startup()
 /// </summary>
 void PhysicsApp::shutdown() {
 	
+	delete m_quitText;
+	delete m_instructionText;
 	delete m_font;
 	delete m_2dRenderer;
 	delete m_physicsScene;
+
+	if (m_divergedFrames > 0)
+		printf("Replay diverged on %u frames\n", m_divergedFrames);
 }
 
 /// <summary>
@@ -85,7 +108,18 @@ void PhysicsApp::update(float deltaTime) {
 
 	aie::Gizmos::clear();
 
+	// A replay should reach every frame on the same fixed step it was recorded on, otherwise the simulation has diverged.
+	// Every frame after the first divergence is likely to differ too, so only that one is printed
+	if (input->isReplaying() && input->getReplayStepIndex() != m_physicsScene->getStepIndex())
+	{
+		if (m_divergedFrames++ == 0)
+			printf("Replay diverged: recorded step %llu, simulated step %llu\n", input->getReplayStepIndex(), m_physicsScene->getStepIndex());
+	}
+
 	m_physicsScene->update(deltaTime);
+
+	// Record the step that the next frame's input will be applied on
+	input->setStepIndex(m_physicsScene->getStepIndex());
 	m_physicsScene->draw();
 
 	// Update the camera position using the arrow keys
@@ -112,6 +146,37 @@ void PhysicsApp::update(float deltaTime) {
 	if (input->isKeyDown(aie::INPUT_KEY_ESCAPE))
 		quit();
 
+	// Toggle deterministic lockstep mode
+	if (input->wasKeyPressed(aie::INPUT_KEY_F3))
+	{
+		m_physicsScene->setDeterministic(!m_physicsScene->isDeterministic());
+	}
+
+	// Save a snapshot of the physics scene, or restore the last saved snapshot
+	if (input->wasKeyPressed(aie::INPUT_KEY_F5))
+	{
+		m_physicsScene->saveSnapshotToFile("./snapshot.bin");
+	}
+	if (input->wasKeyPressed(aie::INPUT_KEY_F9) && m_physicsScene->loadSnapshotFromFile("./snapshot.bin"))
+	{
+		findPlayerSpring();
+	}
+
+	// Toggle recording of the per-step simulation counters, writing them out when recording stops
+	if (input->wasKeyPressed(aie::INPUT_KEY_F2))
+	{
+		if (aie::Counters::isRecording())
+		{
+			aie::Counters::setRecording(false);
+			aie::Counters::exportCSV("./counters.csv");
+			aie::Counters::clearHistory();
+		}
+		else
+		{
+			aie::Counters::setRecording(true);
+		}
+	}
+
 	// Update the second contact point of the player spring with the current mouse pos this frame
 	if (m_playerSpring && m_playerSpring->isActive())
 	{
@@ -128,7 +193,7 @@ void PhysicsApp::update(float deltaTime) {
 		int xScreen, yScreen;
 		input->getMouseXY(&xScreen, &yScreen);
 		vec2 worldPos = screenToWorld(vec2(xScreen, yScreen));
-		aie::Gizmos::add2DCircle(worldPos, 1, 32, { 1, 0, 0, 1 });
+		aie::Gizmos::add2DCircleInstanced(worldPos, 1, { 1, 0, 0, 1 });
 		
 		// Find the rig underneath the mouse
 		RigidBody* rig = m_physicsScene->objectUnderPoint(worldPos);
@@ -170,9 +235,19 @@ void PhysicsApp::draw() {
 	// output some text, uses the last used colour
 	char fps[32];
 	sprintf_s(fps, 32, "FPS: %i", getFPS());
-	m_2dRenderer->drawText(m_font, fps, 0, 720 - 32);
-	m_2dRenderer->drawText(m_font, "Press ESC to quit!", 0, 720 - 64);
-	m_2dRenderer->drawText(m_font, "Click and drag on shapes to pull them!", 50, 50);
+	m_fpsText.set(m_font, fps);
+	m_2dRenderer->drawText(m_fpsText, 0, 720 - 32);
+	m_2dRenderer->drawStaticText(m_quitText);
+
+	// In deterministic mode show the step and state hash so that runs can be compared by eye
+	if (m_physicsScene->isDeterministic())
+	{
+		char stepHash[64];
+		sprintf_s(stepHash, 64, "Step: %llu Hash: %016llx", m_physicsScene->getStepIndex(), m_physicsScene->getStateHash());
+		m_stepHashText.set(m_font, stepHash);
+		m_2dRenderer->drawText(m_stepHashText, 0, 720 - 96);
+	}
+	m_2dRenderer->drawStaticText(m_instructionText);
 
 	static float aspectRatio = 16 / 9.f;
 	aie::Gizmos::draw2D(glm::ortho<float>(-extents, extents, -extents / aspectRatio, extents / aspectRatio, -1.0f, 1.0f));
@@ -218,3 +293,23 @@ void PhysicsApp::attachPlayerSpring(RigidBody* other, vec2 contact, vec2 mousePo
 	m_playerSpring->setContact1(contact);
 	m_playerSpring->setContact2(mousePos);
 }
+
+/// <summary>
+/// findPlayerSpring() is called after the physics scene is restored from a snapshot, as the
+/// restore replaces every actor. The player spring is the only spring that is attached to a
+/// point in the world rather than a second rigid body, so the first spring with no second body
+/// becomes the new player spring (or nullptr if the snapshot was saved before one was created).
+/// </summary>
+void PhysicsApp::findPlayerSpring()
+{
+	m_playerSpring = nullptr;
+	for (auto actor : m_physicsScene->getActors())
+	{
+		Spring* spring = dynamic_cast<Spring*>(actor);
+		if (spring && spring->getBody2() == nullptr)
+		{
+			m_playerSpring = spring;
+			return;
+		}
+	}
+}
@@ -4,6 +4,8 @@
 #include "glm/ext.hpp"
 #include "Gizmos.h"
 #include "Renderer2D.h"
+#include "TextLayout.h"
+#include "StaticText.h"
 #include "PhysicsScene.h"
 #include "Spring.h"
 
@@ -30,16 +32,28 @@ public:
 
 	// Used to attach rigid bodies in the scene to the player's mouse
 	void attachPlayerSpring(RigidBody* other, vec2 contact, vec2 mousePos);
+	// Finds the player spring in the physics scene after it is restored from a snapshot
+	void findPlayerSpring();
 
 protected:
 
 	aie::Renderer2D*	m_2dRenderer;
 	aie::Font*			m_font;
 
+	// Text that changes is kept laid out so only the characters that change are laid out again,
+	// and text that never changes is uploaded once
+	aie::TextLayout		m_fpsText;
+	aie::TextLayout		m_stepHashText;
+	aie::StaticText*	m_quitText;
+	aie::StaticText*	m_instructionText;
+
 	static const float extents;
 	static const float aspectRatio;
 
 	float m_timer;
 	PhysicsScene* m_physicsScene;
 	Spring* m_playerSpring;
+
+	// Frames of a replay that ran on a different fixed step than they were recorded on. Only the first is printed
+	unsigned int m_divergedFrames;
 };
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "PhysicsCounters.h"
+
+/// <summary>
+/// get() registers all of the physics counters with aie::Counters on first use, and
+/// returns the ids so that they can be incremented without any name lookups.
+/// </summary>
+/// <returns>The registered physics counter ids.</returns>
+const PhysicsCounters& PhysicsCounters::get()
+{
+	static const PhysicsCounters counters =
+	{
+		aie::Counters::registerCounter("pairsTested"),
+		aie::Counters::registerCounter("contacts"),
+		aie::Counters::registerCounter("fixedSteps"),
+		aie::Counters::registerCounter("impulses"),
+		aie::Counters::registerCounter("cornerAllocations")
+	};
+
+	return counters;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "Counters.h"
+
+/// <summary>
+/// PhysicsCounters stores the ids of the aie::Counters that the physics simulation increments
+/// while it runs. The counters are registered the first time get() is called, so that registration
+/// never depends on the order in which static objects are initialised across translation units.
+/// </summary>
+struct PhysicsCounters
+{
+	unsigned int pairsTested;		// Pairs of shapes passed to a collision detection function
+	unsigned int contacts;			// Collision detection functions that found and resolved a contact
+	unsigned int fixedSteps;		// Fixed time steps run by PhysicsScene::update()
+	unsigned int impulses;			// Calls to RigidBody::applyForce()
+	unsigned int cornerAllocations;	// Corner arrays allocated by OBB::getCorners()
+
+	static const PhysicsCounters& get();
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <glm/glm.hpp>
 #include "Gizmos.h"
+#include "Snapshot.h"
 
 using namespace glm;
 
@@ -35,6 +36,10 @@ public:
 	virtual void draw() = 0;
 	virtual bool isInside(vec2 point) { return false; }
 
+	// Write and read the full state of this object for PhysicsScene snapshots, children extend these with their own members
+	virtual void writeState(SnapshotWriter& writer) const { writer.write(m_colour); writer.write(m_isKinematic); writer.write(m_elasticity); }
+	virtual void readState(SnapshotReader& reader) { reader.read(m_colour); reader.read(m_isKinematic); reader.read(m_elasticity); }
+
 	// Getters
 	int getShapeID() { return static_cast<int>(m_shapeID); }
 	bool getIsKinematic() { return m_isKinematic; }
@@ -1,4 +1,11 @@
 #include "PhysicsScene.h"
+#include "PhysicsCounters.h"
+#include <stdio.h>
+#include <algorithm>
+
+const unsigned int PhysicsScene::snapshotMagic = 0x504E5350; // "PSNP"
+const unsigned int PhysicsScene::snapshotVersion = 3;
+const char* PhysicsScene::planeLayerName = "PhysicsScene planes";
 
 /// <summary>
 /// PhysicsScene() simply sets the fixed timestep of
@@ -8,6 +15,11 @@
 /// </summary>
 PhysicsScene::PhysicsScene()
 {
+	m_accumulatedTime = 0.0f;
+	m_isDeterministic = false;
+	m_stepIndex = 0;
+	m_stateHash = 0;
+	m_isPlaneLayerDirty = true;
 	setTimeStep(0.01f);
 	setGravity(vec2(0, 0.0f));
 }
@@ -32,17 +44,65 @@ PhysicsScene::~PhysicsScene()
 void PhysicsScene::addActor(PhysicsObject* actor)
 {
 	m_actors.push_back(actor);
+	m_isPlaneLayerDirty = true;
+}
+
+/// <summary>
+/// addSceneFile() applies the gravity and time step of a mapped binary scene file to this scene, and
+/// adds an actor for each of its body records. The records are read directly from the mapped file.
+/// </summary>
+/// <param name="sceneFile">The open scene file to add the bodies of.</param>
+void PhysicsScene::addSceneFile(const SceneFile& sceneFile)
+{
+	const SceneFileHeader& header = sceneFile.getHeader();
+	setGravity(header.gravity);
+	setTimeStep(header.timeStep);
+
+	const SceneFileBody* bodies = sceneFile.getBodies();
+	unsigned int bodyCount = sceneFile.getBodyCount();
+	m_actors.reserve(m_actors.size() + bodyCount);
+
+	for (unsigned int i = 0; i < bodyCount; i++)
+	{
+		const SceneFileBody& body = bodies[i];
+
+		PhysicsObject* actor = nullptr;
+		switch ((ShapeType)body.shapeID)
+		{
+		case ShapeType::PLANE:
+			actor = new Plane(body.position, body.orientation, body.colour);
+			break;
+		case ShapeType::SPHERE:
+			actor = new Sphere(body.position, body.orientation, body.velocity, body.angularVelocity, body.mass, body.extents.x, body.elasticity, body.colour);
+			break;
+		case ShapeType::AABB:
+			actor = new AABB(body.position, body.extents.x, body.extents.y, body.velocity, body.mass, body.colour);
+			break;
+		case ShapeType::OBB:
+			actor = new OBB(body.position, body.extents.x, body.extents.y, body.orientation, body.velocity, body.angularVelocity, body.mass, body.colour);
+			break;
+		default:
+			continue;
+		}
+
+		actor->setIsKinematic((body.flags & SceneFile::kinematicFlag) != 0);
+		m_actors.push_back(actor);
+	}
+
+	m_isPlaneLayerDirty = true;
 }
 
 /// <summary>
 /// removeActor() takes an input of the PhysicsObject to remove from the
 /// physics scene, and uses the std::remove() function to remove it from
-/// the m_actors vector.
+/// the m_actors vector. The remaining actors keep their order, which the
+/// collision checks rely on to be deterministic.
 /// </summary>
 /// <param name="actor">The PhysicsObject to remove.</param>
 void PhysicsScene::removeActor(PhysicsObject* actor)
 {
-	remove(m_actors.begin(), m_actors.end(), actor);
+	m_actors.erase(std::remove(m_actors.begin(), m_actors.end(), actor), m_actors.end());
+	m_isPlaneLayerDirty = true;
 }
 
 /// <summary>
@@ -50,38 +110,68 @@ void PhysicsScene::removeActor(PhysicsObject* actor)
 /// call fixedUpdate an all of the actors in the scene each time the accumulated
 /// time has reached the amount of time defined by the fixed timeStep. Every
 /// accumulated time step the function also calls checkForCollisions() which
-/// checks collisions between all actors in the scene.
+/// checks collisions between all actors in the scene, and then closes the step
+/// in aie::Counters so that the per-step simulation counters can be queried.
+/// Actors are always advanced by the fixed time step, and in deterministic mode
+/// the state of the scene is also hashed after every step.
 /// </summary>
 /// <param name="dt">The amount of time past since last frame.</param>
 void PhysicsScene::update(float dt)
 {
-	// Define a static accumulatedTime that is incremented by dt every update
-	static float accumulatedTime = 0.0f;
-	accumulatedTime += dt;
+	// Increment the accumulated time by dt every update
+	m_accumulatedTime += dt;
 
 	// While we have accumulated more time than our fixed timestep, continue to run physics loops
-	while (accumulatedTime >= m_timeStep)
+	while (m_accumulatedTime >= m_timeStep)
 	{
 		for (auto pActor : m_actors)
 		{
-			pActor->fixedUpdate(m_gravity, dt);
+			pActor->fixedUpdate(m_gravity, m_timeStep);
 		}
 		
-		accumulatedTime -= m_timeStep;
+		m_accumulatedTime -= m_timeStep;
 		checkForCollisions();
+
+		m_stepIndex++;
+		if (m_isDeterministic)
+		{
+			m_stateHash = computeStateHash();
+		}
+
+		aie::Counters::increment(PhysicsCounters::get().fixedSteps);
+		aie::Counters::endStep();
 	}
 }
 
 /// <summary>
-/// draw() simply iterates through all actors in the scene and calls
-/// their individual draw() functions. This function is called by the
+/// draw() iterates through all actors in the scene and calls their individual
+/// draw() functions. Planes never move, so they are drawn into a retained gizmo
+/// layer that is uploaded once and only rebuilt after the actors change, while
+/// every other actor is drawn again each frame. This function is called by the
 /// update() loop in the PhysicsApp.
 /// </summary>
 void PhysicsScene::draw()
 {
+	if (m_isPlaneLayerDirty || !aie::Gizmos::hasLayer(planeLayerName))
+	{
+		aie::Gizmos::beginLayer(planeLayerName);
+		for (auto pActor : m_actors)
+		{
+			if (pActor->getShapeID() == (int)ShapeType::PLANE)
+			{
+				pActor->draw();
+			}
+		}
+		aie::Gizmos::endLayer();
+		m_isPlaneLayerDirty = false;
+	}
+
 	for (auto pActor : m_actors)
 	{
-		pActor->draw();
+		if (pActor->getShapeID() != (int)ShapeType::PLANE)
+		{
+			pActor->draw();
+		}
 	}
 }
 
@@ -95,14 +185,44 @@ static fn collisionFunctionArray[] =
 	PhysicsScene::OBB2Plane, PhysicsScene::OBB2Sphere, PhysicsScene::OBB2AABB, PhysicsScene::OBB2OBB
 };
 
+/// <summary>
+/// computeStateHash() writes the state of every actor into a reused buffer, in the same layout as a
+/// snapshot, and returns the 64-bit FNV-1a hash of the bytes together with the step index. Two scenes
+/// on different machines that have run the same steps from the same start only share a hash if every
+/// bit of their state matches, so comparing hashes each step detects a desync on the step it happens.
+/// </summary>
+/// <returns>The hash of the current scene state.</returns>
+unsigned long long PhysicsScene::computeStateHash() const
+{
+	m_hashBuffer.clear();
+	SnapshotWriter writer(m_hashBuffer, m_actors);
+	writer.write(m_stepIndex);
+	for (auto pActor : m_actors)
+	{
+		writer.write(pActor->getShapeID());
+		pActor->writeState(writer);
+	}
+
+	unsigned long long hash = 14695981039346656037ULL;
+	for (char byte : m_hashBuffer)
+	{
+		hash ^= (unsigned char)byte;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 /// <summary>
 /// Called every fixedTimestep by the PhysicsScene's Update(), the function iterates through all actors in the scene,
 /// and for each actors it checks for collisions with each other actor. The function does this by using the enum ShapeID's
 /// of the two objects being checked, and uses their values to index into the collisionFunctionArray to get a pointer to
-/// the correct collision detection function for the two objects.
+/// the correct collision detection function for the two objects. Pairs are always visited in the order of m_actors, so
+/// that collisions are resolved in the same order on every machine.
 /// </summary>
 void PhysicsScene::checkForCollisions()
 {
+	const PhysicsCounters& counters = PhysicsCounters::get();
+
 	// For each actor, check against all other actors
 	int actorCount = m_actors.size();
 	for (int outer = 0; outer < actorCount - 1; outer++)
@@ -126,7 +246,11 @@ void PhysicsScene::checkForCollisions()
 			if (collisionFunctionPtr)
 			{
 				// Trigger the correct collision detection function for the two objects
-				collisionFunctionPtr(object1, object2);
+				aie::Counters::increment(counters.pairsTested);
+				if (collisionFunctionPtr(object1, object2))
+				{
+					aie::Counters::increment(counters.contacts);
+				}
 			}
 		}
 	}
@@ -173,7 +297,7 @@ bool PhysicsScene::sphere2Plane(PhysicsObject* obj1, PhysicsObject* obj2)
 			sphere->resolveCollision(plane, contact, plane->getNormal());
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contact, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(contact, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(sphere->getPosition(), contact, { 1, 0, 0, 1 });
 
 			return true;
@@ -219,7 +343,7 @@ bool PhysicsScene::sphere2Sphere(PhysicsObject* obj1, PhysicsObject* obj2)
 			sphere1->resolveCollision(sphere2, contactPoint, collisionNormal);
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contactPoint, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(contactPoint, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(sphere1->getPosition(), contactPoint, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(sphere2->getPosition(), contactPoint, { 1, 0, 0, 1 });
 
@@ -278,7 +402,7 @@ bool PhysicsScene::OBB2Plane(PhysicsObject* obj1, PhysicsObject* obj2)
 			obb->resolveCollision(plane, contact / (float)numContacts, plane->getNormal());
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contact / (float)numContacts, 2, 100, {1, 0, 0, 1});
+			aie::Gizmos::add2DCircleInstanced(contact / (float)numContacts, 2, {1, 0, 0, 1});
 			aie::Gizmos::add2DLine(obb->getPosition(), contact, { 1, 0, 0, 1 });
 
 			return true;
@@ -332,7 +456,7 @@ bool PhysicsScene::OBB2Sphere(PhysicsObject* obj1, PhysicsObject* obj2)
 			obb->resolveCollision(sphere, contact, collisionNormal);
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contact, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(contact, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(obb->getPosition(), contact, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(sphere->getPosition(), contact, { 1, 0, 0, 1 });
 
@@ -386,7 +510,7 @@ bool PhysicsScene::OBB2OBB(PhysicsObject* obj1, PhysicsObject* obj2)
 			obb1->resolveCollision(obb2, contact / (float)numContacts, collisionNormal);
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contact / (float)numContacts, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(contact / (float)numContacts, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(obb1->getPosition(), contact / (float)numContacts, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(obb2->getPosition(), contact / (float)numContacts, { 1, 0, 0, 1 });
 
@@ -417,6 +541,190 @@ RigidBody* PhysicsScene::objectUnderPoint(vec2 point)
 	return nullptr;
 }
 
+/// <summary>
+/// saveSnapshot() writes the full state of the scene into the passed blob, replacing its contents. The
+/// blob starts with a header holding the magic number, version, scene settings, accumulated time, step
+/// index and hash, and actor count, followed by a table of each actor's ShapeType, and then the state of each actor in the
+/// same order as m_actors (see the writeState() overrides for the layout of each shape).
+/// </summary>
+/// <param name="blob">The blob to write the snapshot into.</param>
+void PhysicsScene::saveSnapshot(vector<char>& blob) const
+{
+	// Reserve enough for the header and the largest actor state so that writing rarely has to reallocate
+	blob.clear();
+	blob.reserve(32 + m_actors.size() * 100);
+	SnapshotWriter writer(blob, m_actors);
+
+	writer.write(snapshotMagic);
+	writer.write(snapshotVersion);
+	writer.write(m_gravity);
+	writer.write(m_timeStep);
+	writer.write(m_accumulatedTime);
+	writer.write(m_isDeterministic);
+	writer.write(m_stepIndex);
+	writer.write(m_stateHash);
+	writer.write((unsigned int)m_actors.size());
+
+	for (auto pActor : m_actors)
+	{
+		writer.write(pActor->getShapeID());
+	}
+	for (auto pActor : m_actors)
+	{
+		pActor->writeState(writer);
+	}
+}
+
+// Constructs an actor of the given shape with placeholder values, which are overwritten when its state is read from a snapshot
+static PhysicsObject* createSnapshotActor(ShapeType shape)
+{
+	switch (shape)
+	{
+	case ShapeType::JOINT:	return new Spring(nullptr, nullptr, vec4(1), 0);
+	case ShapeType::PLANE:	return new Plane(vec2(0, 1), 0, vec4(1));
+	case ShapeType::SPHERE:	return new Sphere(vec2(0), 0, vec2(0), 0, 1, 1, 1, vec4(1));
+	case ShapeType::AABB:	return new AABB(vec2(0), 1, 1, vec2(0), 1, vec4(1));
+	case ShapeType::OBB:	return new OBB(vec2(0), 1, 1, 0, vec2(0), 0, 1, vec4(1));
+	default:				return nullptr;
+	}
+}
+
+/// <summary>
+/// loadSnapshot() restores the scene from a blob written by saveSnapshot(). All actors are first created
+/// from the shape table so that springs can resolve their body indices, and then each actor reads its
+/// state. If the blob has the wrong magic number or version, or is truncated or corrupt, the new actors
+/// are discarded and the scene is left unchanged. Otherwise the existing actors are deleted and replaced,
+/// so any pointers held to them outside of the scene are no longer valid.
+/// </summary>
+/// <param name="data">The start of the snapshot blob.</param>
+/// <param name="size">The size of the snapshot blob in bytes.</param>
+/// <returns>True if the snapshot was restored.</returns>
+bool PhysicsScene::loadSnapshot(const char* data, size_t size)
+{
+	vector<PhysicsObject*> actors;
+	SnapshotReader reader(data, size, actors);
+
+	unsigned int magic, version, actorCount;
+	vec2 gravity;
+	float timeStep, accumulatedTime;
+	bool isDeterministic;
+	unsigned long long stepIndex, stateHash;
+	reader.read(magic);
+	reader.read(version);
+	reader.read(gravity);
+	reader.read(timeStep);
+	reader.read(accumulatedTime);
+	reader.read(isDeterministic);
+	reader.read(stepIndex);
+	reader.read(stateHash);
+	reader.read(actorCount);
+	if (reader.hasFailed() || magic != snapshotMagic || version != snapshotVersion)
+	{
+		return false;
+	}
+
+	// Every actor needs at least its shape id, so reject counts that could not fit before allocating for them
+	if (actorCount > size / sizeof(int))
+	{
+		return false;
+	}
+
+	actors.reserve(actorCount);
+	for (unsigned int i = 0; i < actorCount && !reader.hasFailed(); i++)
+	{
+		int shapeID;
+		reader.read(shapeID);
+
+		PhysicsObject* actor = createSnapshotActor((ShapeType)shapeID);
+		if (!actor)
+		{
+			reader.fail();
+			break;
+		}
+		actors.push_back(actor);
+	}
+
+	for (unsigned int i = 0; i < actors.size() && !reader.hasFailed(); i++)
+	{
+		actors[i]->readState(reader);
+	}
+
+	if (reader.hasFailed() || !reader.isAtEnd())
+	{
+		for (auto pActor : actors)
+		{
+			delete pActor;
+		}
+		return false;
+	}
+
+	for (auto pActor : m_actors)
+	{
+		delete pActor;
+	}
+	m_actors = actors;
+	m_isPlaneLayerDirty = true;
+
+	m_gravity = gravity;
+	m_timeStep = timeStep;
+	m_accumulatedTime = accumulatedTime;
+	m_isDeterministic = isDeterministic;
+	m_stepIndex = stepIndex;
+	m_stateHash = stateHash;
+	return true;
+}
+
+/// <summary>
+/// saveSnapshotToFile() writes a snapshot of the scene to a binary file.
+/// </summary>
+/// <param name="filename">The path of the file to write.</param>
+/// <returns>True if the whole snapshot was written.</returns>
+bool PhysicsScene::saveSnapshotToFile(const char* filename) const
+{
+	vector<char> blob;
+	saveSnapshot(blob);
+
+	FILE* file = nullptr;
+	fopen_s(&file, filename, "wb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	size_t written = fwrite(blob.data(), 1, blob.size(), file);
+	fclose(file);
+	return written == blob.size();
+}
+
+/// <summary>
+/// loadSnapshotFromFile() reads a binary file written by saveSnapshotToFile() and restores the scene from it.
+/// </summary>
+/// <param name="filename">The path of the file to read.</param>
+/// <returns>True if the snapshot was restored.</returns>
+bool PhysicsScene::loadSnapshotFromFile(const char* filename)
+{
+	FILE* file = nullptr;
+	fopen_s(&file, filename, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	vector<char> blob(size > 0 ? size : 0);
+	size_t read = fread(blob.data(), 1, blob.size(), file);
+	fclose(file);
+
+	if (read != blob.size())
+	{
+		return false;
+	}
+	return loadSnapshot(blob.data(), blob.size());
+}
+
 #pragma region AABB related functions not implemented in final submission
 bool PhysicsScene::AABB2Plane(PhysicsObject* obj1, PhysicsObject* obj2)
 {
@@ -453,7 +761,7 @@ bool PhysicsScene::AABB2Plane(PhysicsObject* obj1, PhysicsObject* obj2)
 			aabb->resolveCollision(plane, contact / (float)numContacts, plane->getNormal());
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(contact / (float)numContacts, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(contact / (float)numContacts, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(aabb->getPosition(), contact, { 1, 0, 0, 1 });
 
 			return true;
@@ -506,7 +814,7 @@ bool PhysicsScene::AABB2Sphere(PhysicsObject* obj1, PhysicsObject* obj2)
 			aabb->resolveCollision(sphere, possibleContact, collisionNormal);
 
 			// Draw a line to the contact point
-			aie::Gizmos::add2DCircle(possibleContact, 2, 100, { 1, 0, 0, 1 });
+			aie::Gizmos::add2DCircleInstanced(possibleContact, 2, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(aabb->getPosition(), possibleContact, { 1, 0, 0, 1 });
 			aie::Gizmos::add2DLine(sphere->getPosition(), possibleContact, { 1, 0, 0, 1 });
 
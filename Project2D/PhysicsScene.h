@@ -1,12 +1,14 @@
 #pragma once
 
+#include "PhysicsObject.h"
 #include <vector>
 #include "glm/glm.hpp"
-#include "PhysicsObject.h"
 #include "Sphere.h"
 #include "Plane.h"
 #include "AABB.h"
 #include "OBB.h"
+#include "Spring.h"
+#include "SceneFile.h"
 
 using namespace std;
 using namespace glm;
@@ -26,6 +28,7 @@ public:
 
 	void addActor(PhysicsObject* actor);
 	void removeActor(PhysicsObject* actor);
+	void addSceneFile(const SceneFile& sceneFile);
 
 	void update(float dt);
 	void draw();
@@ -50,6 +53,13 @@ public:
 	static bool OBB2OBB(PhysicsObject* obj1, PhysicsObject* obj2);
 
 	RigidBody* objectUnderPoint(vec2 point);
+	const vector<PhysicsObject*>& getActors() const { return m_actors; }
+
+	// Snapshots store the scene settings, accumulated time, step index and the full state of every actor in a versioned binary blob
+	void saveSnapshot(vector<char>& blob) const;
+	bool loadSnapshot(const char* data, size_t size);
+	bool saveSnapshotToFile(const char* filename) const;
+	bool loadSnapshotFromFile(const char* filename);
 
 	// Accessor functions for m_gravity
 	void setGravity(const vec2 gravity) { m_gravity = gravity; };
@@ -59,9 +69,32 @@ public:
 	void setTimeStep(const float timeStep) { m_timeStep = timeStep; };
 	float getTimeStep() const { return m_timeStep; };
 
+	// Deterministic mode hashes the state of all actors after each fixed step, so that runs on
+	// different machines can be compared step by step. This relies on the project being compiled without
+	// floating point contraction, which Project2D.vcxproj sets (/fp:precise, or -ffp-contract=off with Clang)
+	void setDeterministic(bool value) { m_isDeterministic = value; }
+	bool isDeterministic() const { return m_isDeterministic; }
+	unsigned long long getStepIndex() const { return m_stepIndex; }
+	unsigned long long getStateHash() const { return m_stateHash; }
+	unsigned long long computeStateHash() const;
+
 protected:
 	vec2 m_gravity;
 	float m_timeStep;
+	float m_accumulatedTime;
 	vector<PhysicsObject*> m_actors;
+
+	bool m_isDeterministic;
+	unsigned long long m_stepIndex;	// Fixed steps run since the scene was created
+	unsigned long long m_stateHash;	// Hash of every actor's state after the last fixed step in deterministic mode
+	mutable vector<char> m_hashBuffer;
+
+	// Set whenever the actors change, so that the retained gizmo layer of planes is rebuilt on the next draw
+	bool m_isPlaneLayerDirty;
+	static const char* planeLayerName;
+
+	// Written at the start of every snapshot, the version must be incremented whenever the layout of any actor's state changes
+	static const unsigned int snapshotMagic;
+	static const unsigned int snapshotVersion;
 };
 
@@ -37,3 +37,25 @@ void Plane::draw()
 	aie::Gizmos::add2DTri(start, end, start - (m_normal * 10.0f), m_colour, m_colour, colourFade);
 	aie::Gizmos::add2DTri(end, end - (m_normal * 10.0f), start - (m_normal * 10.0f), m_colour, colourFade, colourFade);
 }
+
+/// <summary>
+/// writeState() extends the PhysicsObject snapshot state with the plane normal and origin distance.
+/// </summary>
+/// <param name="writer">The snapshot being written.</param>
+void Plane::writeState(SnapshotWriter& writer) const
+{
+	PhysicsObject::writeState(writer);
+	writer.write(m_normal);
+	writer.write(m_originDistance);
+}
+
+/// <summary>
+/// readState() reads back the state written by writeState().
+/// </summary>
+/// <param name="reader">The snapshot being read.</param>
+void Plane::readState(SnapshotReader& reader)
+{
+	PhysicsObject::readState(reader);
+	reader.read(m_normal);
+	reader.read(m_originDistance);
+}
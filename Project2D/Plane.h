@@ -15,6 +15,9 @@ public:
     virtual void fixedUpdate(vec2 gravity, float timeStep) override {}
     void draw() override;
 
+    void writeState(SnapshotWriter& writer) const override;
+    void readState(SnapshotReader& reader) override;
+
     // Getters
     vec2 getNormal() { return m_normal; }
     float getOriginDistance() { return m_originDistance; }
@@ -1,4 +1,5 @@
 #include "RigidBody.h"
+#include "PhysicsCounters.h"
 
 /// <summary>
 /// RigidBody has no default constructor, the custom constructor takes a ShapeID for the shape of the collision primitive, a position,
@@ -61,6 +62,8 @@ void RigidBody::fixedUpdate(vec2 gravity, float timeStep)
 /// <param name="contactPoint">The point of force application on this body.</param>
 void RigidBody::applyForce(vec2 force, vec2 contactDisplacement)
 {
+	aie::Counters::increment(PhysicsCounters::get().impulses);
+
 	m_velocity += force / getMass();
 	m_angularVelocity += (contactDisplacement.x * force.y - contactDisplacement.y * force.x) / getMoment();
 }
@@ -165,3 +168,38 @@ void RigidBody::resolveCollision(PhysicsObject* other, vec2 contact, vec2 collis
         }
     }
 }
+
+/// <summary>
+/// writeState() extends the PhysicsObject snapshot state with all of the rigid body's dynamics. The local
+/// axes are written rather than recalculated from the orientation so that a restored body is bit-exact.
+/// </summary>
+/// <param name="writer">The snapshot being written.</param>
+void RigidBody::writeState(SnapshotWriter& writer) const
+{
+    PhysicsObject::writeState(writer);
+    writer.write(m_position);
+    writer.write(m_velocity);
+    writer.write(m_angularVelocity);
+    writer.write(m_mass);
+    writer.write(m_moment);
+    writer.write(m_localX);
+    writer.write(m_localY);
+    writer.write(m_orientation);
+}
+
+/// <summary>
+/// readState() reads back the state written by writeState(), in the same order.
+/// </summary>
+/// <param name="reader">The snapshot being read.</param>
+void RigidBody::readState(SnapshotReader& reader)
+{
+    PhysicsObject::readState(reader);
+    reader.read(m_position);
+    reader.read(m_velocity);
+    reader.read(m_angularVelocity);
+    reader.read(m_mass);
+    reader.read(m_moment);
+    reader.read(m_localX);
+    reader.read(m_localY);
+    reader.read(m_orientation);
+}
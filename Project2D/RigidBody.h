@@ -24,6 +24,10 @@ public:
 	void applyForce(vec2 force, vec2 contactPoint);
 	void resolveCollision(PhysicsObject* actor2, vec2 contact, vec2 collisionNormal = vec2(0,0));
 
+	// Snapshot state
+	virtual void writeState(SnapshotWriter& writer) const override;
+	virtual void readState(SnapshotReader& reader) override;
+
 	// Conversion functions to convert between local and world coordinates based on the local axes of this rigidbody
 	vec2 toWorld(vec2 localPoint) { return m_position + (localPoint.x * m_localX) + (localPoint.y * m_localY); }
 	vec2 toLocal(vec2 worldPoint) { return vec2(dot(worldPoint - m_position, m_localX), dot(worldPoint - m_position, m_localY)); }
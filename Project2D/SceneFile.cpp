@@ -0,0 +1,255 @@
+#include "SceneFile.h"
+#include "PhysicsObject.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+const unsigned int SceneFile::kinematicFlag = 1 << 0;
+const unsigned int SceneFile::fileMagic = 0x4E435350; // "PSCN"
+const unsigned int SceneFile::fileVersion = 1;
+
+/// <summary>
+/// open() maps the whole scene file read-only into memory and checks that the header is valid and
+/// that the body array fits inside the file. No body records are read, so the cost of opening is
+/// independent of the number of bodies and they are paged in as the scene reads them.
+/// </summary>
+/// <param name="filename">The path of the binary scene file.</param>
+/// <returns>True if the file was mapped and is a valid scene file.</returns>
+bool SceneFile::open(const char* filename)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(SceneFileHeader))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// The view keeps the mapping and file open, so both handles can be closed straight away
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	m_data = (const char*)data;
+	m_size = (size_t)fileSize.QuadPart;
+#else
+	int file = ::open(filename, O_RDONLY);
+	if (file == -1)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(SceneFileHeader))
+	{
+		::close(file);
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	m_data = (const char*)data;
+	m_size = (size_t)fileStat.st_size;
+#endif
+
+	// Reject files with a different layout, or whose body array runs past the end of the file
+	const SceneFileHeader& header = getHeader();
+	size_t bodyBytes = (size_t)header.bodyCount * sizeof(SceneFileBody);
+	if (header.magic != fileMagic || header.version != fileVersion ||
+		header.bodyOffset < sizeof(SceneFileHeader) || header.bodyOffset % alignof(SceneFileBody) != 0 ||
+		header.bodyOffset > m_size || bodyBytes / sizeof(SceneFileBody) != header.bodyCount || bodyBytes > m_size - header.bodyOffset)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// close() unmaps the scene file if one is open. Any pointers returned by getBodies() are
+/// no longer valid afterwards.
+/// </summary>
+void SceneFile::close()
+{
+	if (m_data == nullptr)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+#else
+	munmap((void*)m_data, m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+/// <summary>
+/// convertText() reads a text scene description and writes it out as a binary scene file. Each line of
+/// the text file holds one keyword followed by its values, blank lines and lines starting with # are
+/// ignored, and any body line can end with the word kinematic:
+///   gravity x y
+///   timestep seconds
+///   sphere x y radius mass vx vy angularVelocity elasticity r g b a
+///   obb x y width height orientation mass vx vy angularVelocity r g b a
+///   aabb x y width height mass vx vy r g b a
+///   plane nx ny distance r g b a
+/// </summary>
+/// <param name="textFilename">The path of the text scene description.</param>
+/// <param name="binaryFilename">The path of the binary scene file to write.</param>
+/// <returns>True if every line was converted and the binary file was written.</returns>
+bool SceneFile::convertText(const char* textFilename, const char* binaryFilename)
+{
+	ifstream textFile(textFilename);
+	if (!textFile.is_open())
+	{
+		return false;
+	}
+
+	SceneFileHeader header = {};
+	header.magic = fileMagic;
+	header.version = fileVersion;
+	header.bodyOffset = sizeof(SceneFileHeader);
+	header.gravity = vec2(0, 0);
+	header.timeStep = 0.01f;
+
+	vector<SceneFileBody> bodies;
+
+	string line;
+	int lineNumber = 0;
+	while (getline(textFile, line))
+	{
+		lineNumber++;
+
+		istringstream stream(line);
+		string keyword;
+		if (!(stream >> keyword) || keyword[0] == '#')
+		{
+			continue;
+		}
+
+		SceneFileBody body = {};
+		body.elasticity = 1.0f;
+
+		if (keyword == "gravity")
+		{
+			stream >> header.gravity.x >> header.gravity.y;
+		}
+		else if (keyword == "timestep")
+		{
+			stream >> header.timeStep;
+		}
+		else if (keyword == "sphere")
+		{
+			body.shapeID = (int)ShapeType::SPHERE;
+			stream >> body.position.x >> body.position.y >> body.extents.x >> body.mass >> body.velocity.x >> body.velocity.y
+				>> body.angularVelocity >> body.elasticity >> body.colour.r >> body.colour.g >> body.colour.b >> body.colour.a;
+		}
+		else if (keyword == "obb")
+		{
+			body.shapeID = (int)ShapeType::OBB;
+			stream >> body.position.x >> body.position.y >> body.extents.x >> body.extents.y >> body.orientation >> body.mass
+				>> body.velocity.x >> body.velocity.y >> body.angularVelocity >> body.colour.r >> body.colour.g >> body.colour.b >> body.colour.a;
+		}
+		else if (keyword == "aabb")
+		{
+			body.shapeID = (int)ShapeType::AABB;
+			stream >> body.position.x >> body.position.y >> body.extents.x >> body.extents.y >> body.mass
+				>> body.velocity.x >> body.velocity.y >> body.colour.r >> body.colour.g >> body.colour.b >> body.colour.a;
+		}
+		else if (keyword == "plane")
+		{
+			body.shapeID = (int)ShapeType::PLANE;
+			body.flags = kinematicFlag;
+			stream >> body.position.x >> body.position.y >> body.orientation >> body.colour.r >> body.colour.g >> body.colour.b >> body.colour.a;
+		}
+		else
+		{
+			printf("%s(%i): unknown keyword '%s'\n", textFilename, lineNumber, keyword.c_str());
+			return false;
+		}
+
+		if (stream.fail())
+		{
+			printf("%s(%i): missing or invalid values for '%s'\n", textFilename, lineNumber, keyword.c_str());
+			return false;
+		}
+
+		if (keyword == "gravity" || keyword == "timestep")
+		{
+			continue;
+		}
+
+		string modifier;
+		if (stream >> modifier)
+		{
+			if (modifier != "kinematic")
+			{
+				printf("%s(%i): unknown modifier '%s'\n", textFilename, lineNumber, modifier.c_str());
+				return false;
+			}
+			body.flags |= kinematicFlag;
+		}
+
+		bodies.push_back(body);
+	}
+
+	header.bodyCount = (unsigned int)bodies.size();
+
+	FILE* binaryFile = nullptr;
+	fopen_s(&binaryFile, binaryFilename, "wb");
+	if (binaryFile == nullptr)
+	{
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, binaryFile) == 1;
+	if (written && !bodies.empty())
+	{
+		written = fwrite(bodies.data(), sizeof(SceneFileBody), bodies.size(), binaryFile) == bodies.size();
+	}
+	fclose(binaryFile);
+
+	return written;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+using namespace glm;
+
+/// <summary>
+/// The header at the start of every binary scene file. The body records start at bodyOffset,
+/// which keeps them aligned so that they can be read in place from the mapped file.
+/// </summary>
+struct SceneFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int bodyCount;
+	unsigned int bodyOffset;
+	vec2 gravity;
+	float timeStep;
+	unsigned int reserved;
+};
+
+/// <summary>
+/// A fixed-size record for a single body in a binary scene file. Every shape uses the same record
+/// so that the body array can be indexed directly. Planes store their normal in position and their
+/// origin distance in orientation, spheres store their radius in extents.x, and boxes store their
+/// full width and height in extents.
+/// </summary>
+struct SceneFileBody
+{
+	int shapeID;
+	unsigned int flags;
+	vec2 position;
+	vec2 velocity;
+	float orientation;
+	float angularVelocity;
+	float mass;
+	float elasticity;
+	vec2 extents;
+	vec4 colour;
+};
+
+static_assert(sizeof(SceneFileHeader) == 32, "SceneFileHeader layout is part of the file format");
+static_assert(sizeof(SceneFileBody) == 64, "SceneFileBody layout is part of the file format");
+
+/// <summary>
+/// SceneFile memory-maps a binary scene file and exposes its header and body records in place, so
+/// opening a scene costs a validation of the header and nothing else. Binary scene files are built
+/// from a readable text description by convertText(), see bin/scenes/default.txt for the format.
+/// </summary>
+class SceneFile
+{
+public:
+	SceneFile() : m_data(nullptr), m_size(0) {}
+	~SceneFile() { close(); }
+
+	SceneFile(const SceneFile&) = delete;
+	SceneFile& operator=(const SceneFile&) = delete;
+
+	bool open(const char* filename);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	const SceneFileHeader& getHeader() const { return *(const SceneFileHeader*)m_data; }
+	const SceneFileBody* getBodies() const { return (const SceneFileBody*)(m_data + getHeader().bodyOffset); }
+	unsigned int getBodyCount() const { return getHeader().bodyCount; }
+
+	// Builds a binary scene file from a text description
+	static bool convertText(const char* textFilename, const char* binaryFilename);
+
+	// Flags for SceneFileBody::flags
+	static const unsigned int kinematicFlag;
+
+	static const unsigned int fileMagic;
+	static const unsigned int fileVersion;
+
+protected:
+	const char* m_data;
+	size_t m_size;
+};
@@ -0,0 +1,41 @@
+#include "Snapshot.h"
+#include "PhysicsObject.h"
+
+/// <summary>
+/// indexOf() returns the index of the given actor in the scene's actor list, or -1 if the
+/// actor is null or is not part of the scene being saved.
+/// </summary>
+/// <param name="actor">The actor to find.</param>
+/// <returns>The index of the actor, or -1 if it is not in the scene.</returns>
+int SnapshotWriter::indexOf(const PhysicsObject* actor) const
+{
+	for (int i = 0; i < (int)m_actors.size(); i++)
+	{
+		if (m_actors[i] == actor)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/// <summary>
+/// actorAt() resolves an index written by SnapshotWriter::indexOf() back into an actor of the scene
+/// being restored. An index of -1 resolves to null, and any other out of range index marks the
+/// reader as failed.
+/// </summary>
+/// <param name="index">The index of the actor in the restored actor list.</param>
+/// <returns>The actor at the index, or nullptr.</returns>
+PhysicsObject* SnapshotReader::actorAt(int index)
+{
+	if (index == -1)
+	{
+		return nullptr;
+	}
+	if (index < 0 || index >= (int)m_actors.size())
+	{
+		m_failed = true;
+		return nullptr;
+	}
+	return m_actors[index];
+}
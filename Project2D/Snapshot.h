@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include <cstring>
+
+using namespace std;
+
+class PhysicsObject;
+
+/// <summary>
+/// SnapshotWriter appends the raw bytes of plain values to a binary blob, and is passed to each
+/// PhysicsObject's writeState() when a PhysicsScene is saved. The writer also holds the scene's
+/// actor list so that objects referencing other actors (such as springs) can store an index
+/// into the list rather than a pointer.
+/// </summary>
+class SnapshotWriter
+{
+public:
+	SnapshotWriter(vector<char>& blob, const vector<PhysicsObject*>& actors) : m_blob(blob), m_actors(actors) {}
+
+	template <typename T>
+	void write(const T& value)
+	{
+		size_t offset = m_blob.size();
+		m_blob.resize(offset + sizeof(T));
+		memcpy(m_blob.data() + offset, &value, sizeof(T));
+	}
+
+	int indexOf(const PhysicsObject* actor) const;
+
+protected:
+	vector<char>& m_blob;
+	const vector<PhysicsObject*>& m_actors;
+};
+
+/// <summary>
+/// SnapshotReader reads plain values back out of a blob written by SnapshotWriter, in the same order
+/// they were written. Reading past the end of the blob zeroes the value and marks the reader as failed
+/// rather than reading out of bounds, so that a truncated snapshot can be rejected after reading.
+/// </summary>
+class SnapshotReader
+{
+public:
+	SnapshotReader(const char* data, size_t size, const vector<PhysicsObject*>& actors) : m_data(data), m_size(size), m_offset(0), m_failed(false), m_actors(actors) {}
+
+	template <typename T>
+	void read(T& value)
+	{
+		if (m_failed || m_offset + sizeof(T) > m_size)
+		{
+			m_failed = true;
+			memset(&value, 0, sizeof(T));
+			return;
+		}
+		memcpy(&value, m_data + m_offset, sizeof(T));
+		m_offset += sizeof(T);
+	}
+
+	PhysicsObject* actorAt(int index);
+
+	void fail() { m_failed = true; }
+	bool hasFailed() const { return m_failed; }
+	bool isAtEnd() const { return m_offset == m_size; }
+
+protected:
+	const char* m_data;
+	size_t m_size;
+	size_t m_offset;
+	bool m_failed;
+	const vector<PhysicsObject*>& m_actors;
+};
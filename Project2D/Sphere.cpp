@@ -25,7 +25,7 @@ Sphere::Sphere(vec2 position, float orientation, vec2 velocity, float angularVel
 }
 
 /// <summary>
-/// draw() is an override function which simply uses the add2DCircle function in the 
+/// draw() is an override function which simply uses the add2DCircleInstanced function in the 
 /// AIE Gizmos namespace to draw a circle of radius m_radius at m_position, the function
 /// also draws a line from the centre of the circle out to the radius based on the circle's
 /// current orientation, so as to visualise the rotation.
@@ -33,7 +33,7 @@ Sphere::Sphere(vec2 position, float orientation, vec2 velocity, float angularVel
 void Sphere::draw()
 {
 	vec2 end = vec2(cos(m_orientation), sin(m_orientation)) * m_radius;
-	aie::Gizmos::add2DCircle(m_position, m_radius, 100, m_colour);
+	aie::Gizmos::add2DCircleInstanced(m_position, m_radius, m_colour);
 	aie::Gizmos::add2DLine(m_position, m_position + end, vec4(0, 0, 0, 1));
 }
 
@@ -46,3 +46,23 @@ bool Sphere::isInside(vec2 point)
 {
 	return distance(point, m_position) <= m_radius;
 }
+
+/// <summary>
+/// writeState() extends the RigidBody snapshot state with the radius of the sphere.
+/// </summary>
+/// <param name="writer">The snapshot being written.</param>
+void Sphere::writeState(SnapshotWriter& writer) const
+{
+	RigidBody::writeState(writer);
+	writer.write(m_radius);
+}
+
+/// <summary>
+/// readState() reads back the state written by writeState().
+/// </summary>
+/// <param name="reader">The snapshot being read.</param>
+void Sphere::readState(SnapshotReader& reader)
+{
+	RigidBody::readState(reader);
+	reader.read(m_radius);
+}
@@ -17,6 +17,9 @@ public:
     // Draws the sphere class as a 2D circle
     void draw() override;
     bool isInside(vec2 point) override;
+
+    void writeState(SnapshotWriter& writer) const override;
+    void readState(SnapshotReader& reader) override;
     
     // Getters
     float getRadius() { return m_radius; }
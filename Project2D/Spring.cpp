@@ -80,3 +80,69 @@ void Spring::draw()
 {
 	if (m_isActive) { aie::Gizmos::add2DLine(getContact1(), getContact2(), m_colour); }
 }
+
+/// <summary>
+/// writeState() extends the PhysicsObject snapshot state with the spring's variables. The two bodies are
+/// written as their index in the scene's actor list (or -1 when unattached) as pointers are not valid
+/// once restored.
+/// </summary>
+/// <param name="writer">The snapshot being written.</param>
+void Spring::writeState(SnapshotWriter& writer) const
+{
+	PhysicsObject::writeState(writer);
+	writer.write(writer.indexOf(m_body1));
+	writer.write(writer.indexOf(m_body2));
+	writer.write(m_contact1);
+	writer.write(m_contact2);
+	writer.write(m_damping);
+	writer.write(m_restLength);
+	writer.write(m_springCoefficient);
+	writer.write(m_isActive);
+}
+
+// Only spheres, AABBs and OBBs derive from RigidBody, so any other actor referenced by a spring means the snapshot is corrupt
+static RigidBody* toRigidBody(SnapshotReader& reader, PhysicsObject* actor)
+{
+	if (!actor)
+	{
+		return nullptr;
+	}
+
+	ShapeType shape = (ShapeType)actor->getShapeID();
+	if (shape != ShapeType::SPHERE && shape != ShapeType::AABB && shape != ShapeType::OBB)
+	{
+		reader.fail();
+		return nullptr;
+	}
+	return static_cast<RigidBody*>(actor);
+}
+
+/// <summary>
+/// readState() reads back the state written by writeState(), resolving the body indices into the
+/// restored actors. The reader is marked as failed if an index does not refer to a rigid body, or if
+/// the first body is missing.
+/// </summary>
+/// <param name="reader">The snapshot being read.</param>
+void Spring::readState(SnapshotReader& reader)
+{
+	PhysicsObject::readState(reader);
+
+	int body1Index, body2Index;
+	reader.read(body1Index);
+	reader.read(body2Index);
+	m_body1 = toRigidBody(reader, reader.actorAt(body1Index));
+	m_body2 = toRigidBody(reader, reader.actorAt(body2Index));
+
+	// A spring always has a first body, fixedUpdate() uses it unchecked
+	if (!m_body1)
+	{
+		reader.fail();
+	}
+
+	reader.read(m_contact1);
+	reader.read(m_contact2);
+	reader.read(m_damping);
+	reader.read(m_restLength);
+	reader.read(m_springCoefficient);
+	reader.read(m_isActive);
+}
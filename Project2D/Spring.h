@@ -18,6 +18,10 @@ public:
     void fixedUpdate(vec2 gravity, float timeStep) override;
     void draw() override;
 
+    // Bodies are written as indices into the scene's actor list and resolved back into pointers when read
+    void writeState(SnapshotWriter& writer) const override;
+    void readState(SnapshotReader& reader) override;
+
     // Converts the local contact points of each body into world coordinates and returns the position (or just returns m_contact if already in world coords)
     vec2 getContact1() { return m_body1 ? m_body1->toWorld(m_contact1) : m_contact1; }
     vec2 getContact2() { return m_body2 ? m_body2->toWorld(m_contact2) : m_contact2; }
@@ -25,6 +29,8 @@ public:
     // Setters for the spring's rigid bodies and contact points
     void setBody1(RigidBody* rig) { m_body1 = rig; }
     void setBody2(RigidBody* rig) { m_body2 = rig; }
+    RigidBody* getBody1() { return m_body1; }
+    RigidBody* getBody2() { return m_body2; }
     void setContact1(vec2 contact) { m_contact1 = contact; }
     void setContact2(vec2 contact) { m_contact2 = contact; }
 
@@ -1,14 +1,36 @@
 #include "PhysicsApp.h"
 
+#include <string.h>
+
 /// <summary>
 /// Main simply instantiates a new PhysicsApp and calls run on it,
-/// which continually loops gameplay until the game is closed.
+/// which continually loops gameplay until the game is closed. Passing
+/// --record filename records the session's input to a file, and passing
+/// --replay filename plays a recorded session back without any user input.
+/// Passing --capture path.y4m saves every frame to a raw video, and
+/// --capture path.png saves them as numbered images path_000000.png onwards.
 /// </summary>
-int main() {
+int main(int argc, char* argv[]) {
 	
 	// allocation
 	auto app = new PhysicsApp();
 
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--record") == 0)
+		{
+			app->recordInput(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--replay") == 0)
+		{
+			app->replayInput(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--capture") == 0)
+		{
+			app->captureFrames(argv[++i]);
+		}
+	}
+
 	// initialise and loop
 	app->run("AIE", 1280, 720, false);
 
@@ -21,8 +21,8 @@ bool Application3D::startup() {
 	
 	setBackgroundColour(0.25f, 0.25f, 0.25f);
 
-	// initialise gizmo primitive counts
-	Gizmos::create(10000, 10000, 10000, 10000);
+	// initialise gizmo buffer sizes, they grow if a frame needs more
+	Gizmos::create(64, 64, 0, 0, 0);
 
 	// create simple camera transforms
 	m_viewMatrix = glm::lookAt(vec3(10), vec3(0), vec3(0, 1, 0));
@@ -50,27 +50,39 @@ void Application3D::update(float deltaTime) {
 	// wipe the gizmos clean for this frame
 	Gizmos::clear();
 
-	// draw a simple grid with gizmos
-	vec4 white(1);
-	vec4 black(0, 0, 0, 1);
-	for (int i = 0; i < 21; ++i) {
-		Gizmos::addLine(vec3(-10 + i, 0, 10),
-						vec3(-10 + i, 0, -10),
-						i == 10 ? white : black);
-		Gizmos::addLine(vec3(10, 0, -10 + i),
-						vec3(-10, 0, -10 + i),
-						i == 10 ? white : black);
+	// curved gizmos use fewer segments when they're small on screen
+	Gizmos::setTessellation(m_projectionMatrix, m_viewMatrix, (float)getWindowHeight());
+
+	// the grid, axis and demo shapes never change, so they're built once into a retained layer
+	if (Gizmos::hasLayer("static") == false) {
+		Gizmos::beginLayer("static");
+
+		// draw a simple grid with gizmos
+		vec4 white(1);
+		vec4 black(0, 0, 0, 1);
+		for (int i = 0; i < 21; ++i) {
+			Gizmos::addLine(vec3(-10 + i, 0, 10),
+							vec3(-10 + i, 0, -10),
+							i == 10 ? white : black);
+			Gizmos::addLine(vec3(10, 0, -10 + i),
+							vec3(-10, 0, -10 + i),
+							i == 10 ? white : black);
+		}
+
+		// add a transform so that we can see the axis
+		Gizmos::addTransform(mat4(1));
+
+		// demonstrate a few shapes
+		Gizmos::addRing(vec3(5, 0, -5), 1, 1.5f, 8, vec4(0, 1, 0, 1));
+		Gizmos::addDisk(vec3(-5, 0, 5), 1, 16, vec4(1, 1, 0, 1));
+		Gizmos::addArc(vec3(-5, 0, -5), 0, 2, 1, 8, vec4(1, 0, 1, 1));
+
+		Gizmos::endLayer();
 	}
 
-	// add a transform so that we can see the axis
-	Gizmos::addTransform(mat4(1));
-
-	// demonstrate a few shapes
+	// see-through shapes are added every frame, as a layer's transparent triangles are never sorted
 	Gizmos::addAABBFilled(vec3(0), vec3(1), vec4(0, 0.5f, 1, 0.25f));
 	Gizmos::addSphere(vec3(5, 0, 5), 1, 8, 8, vec4(1, 0, 0, 0.5f));
-	Gizmos::addRing(vec3(5, 0, -5), 1, 1.5f, 8, vec4(0, 1, 0, 1));
-	Gizmos::addDisk(vec3(-5, 0, 5), 1, 16, vec4(1, 1, 0, 1));
-	Gizmos::addArc(vec3(-5, 0, -5), 0, 2, 1, 8, vec4(1, 0, 1, 1));
 
 	mat4 t = glm::rotate(mat4(1), time, glm::normalize(vec3(1, 1, 1)));
 	t[3] = vec4(-2, 0, 0, 1);
@@ -4,6 +4,10 @@
 #include <glm/glm.hpp>
 #include <iostream>
 #include "Input.h"
+#include "GLState.h"
+#include "TextureLoader.h"
+#include "TextureManager.h"
+#include "FrameCapture.h"
 #include "imgui_glfw3.h"
 
 namespace aie {
@@ -11,7 +15,9 @@ namespace aie {
 Application::Application()
 	: m_window(nullptr),
 	m_gameOver(false),
-	m_fps(0) {
+	m_fps(0),
+	m_captureFramesPerSecond(60),
+	m_capture(nullptr) {
 }
 
 Application::~Application() {
@@ -36,15 +42,18 @@ bool Application::createWindow(const char* title, int width, int height, bool fu
 		return false;
 	}
 
-	glfwSetWindowSizeCallback(m_window, [](GLFWwindow*, int w, int h){ glViewport(0, 0, w, h); });
+	// read the context's starting state, everything after this changes it through GLState
+	GLState::reset();
+
+	glfwSetWindowSizeCallback(m_window, [](GLFWwindow*, int w, int h){ GLState::setViewport(0, 0, w, h); });
 
 	glClearColor(0, 0, 0, 1);
 
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
+	GLState::setDepthTest(true);
+	GLState::setCullFace(true);
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::setBlend(true);
+	GLState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// start input manager
 	Input::create();
@@ -59,6 +68,7 @@ void Application::destroyWindow() {
 
 	ImGui_Shutdown();
 	Input::destroy();
+	TextureLoader::destroy();
 
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
@@ -70,6 +80,25 @@ void Application::run(const char* title, int width, int height, bool fullscreen)
 	if (createWindow(title,width,height, fullscreen) &&
 		startup()) {
 
+		Input* input = Input::getInstance();
+		if (!m_recordFilename.empty() && !input->startRecording(m_recordFilename.c_str()))
+			std::cout << "Failed to record input to " << m_recordFilename << std::endl;
+		if (!m_replayFilename.empty()) {
+			if (input->startReplay(m_replayFilename.c_str()))
+				setVSync(false);
+			else
+				std::cout << "Failed to replay input from " << m_replayFilename << std::endl;
+		}
+		if (!m_captureFilename.empty()) {
+			std::string path = m_captureFilename;
+			size_t length = path.size();
+			bool video = length >= 4 && path.compare(length - 4, 4, ".y4m") == 0;
+			if (length >= 4 && path.compare(length - 4, 4, ".png") == 0)
+				path.resize(length - 4);
+			m_capture = new FrameCapture(path.c_str(), video ? FrameCapture::Y4M : FrameCapture::PNG,
+										 m_captureFramesPerSecond);
+		}
+
 		// variables for timing
 		double prevTime = glfwGetTime();
 		double currTime = 0;
@@ -107,16 +136,34 @@ void Application::run(const char* title, int width, int height, bool fullscreen)
 				fpsInterval -= 1.0f;
 			}
 
+			// record this frame's input, or replace it with the next recorded frame
+			float frameTime = float(deltaTime);
+			if (input->isReplaying()) {
+				if (!input->replayFrame(frameTime)) {
+					quit();
+					break;
+				}
+			}
+			else
+				input->recordFrame(frameTime);
+
+			// upload textures that have finished loading in the background, then keep them within budget
+			TextureLoader::update();
+			TextureManager::update();
+
 			// clear imgui
 			ImGui_NewFrame();
 
-			update(float(deltaTime));
+			update(frameTime);
 
 			draw();
 
 			// draw IMGUI last
 			ImGui::Render();
 
+			if (m_capture != nullptr)
+				m_capture->capture(getWindowWidth(), getWindowHeight());
+
 			//present backbuffer to the monitor
 			glfwSwapBuffers(m_window);
 
@@ -126,6 +173,12 @@ void Application::run(const char* title, int width, int height, bool fullscreen)
 	}
 
 	// cleanup
+	if (m_capture != nullptr) {
+		std::cout << "Captured " << m_capture->getCapturedCount() << " frames, dropped "
+				  << m_capture->getDroppedCount() << std::endl;
+		delete m_capture;
+		m_capture = nullptr;
+	}
 	shutdown();
 	destroyWindow();
 }
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <string>
+
 // forward declared structure for access to GLFW window
 struct GLFWwindow;
 
 namespace aie {
 
+class FrameCapture;
+
 // this is the pure-virtual base class that wraps up an application for us.
 // we derive our own applications from this class
 class Application {
@@ -39,6 +43,21 @@ public:
 	// sets m_gameOver to true which will close the application safely when the frame ends
 	void quit() { m_gameOver = true; }
 
+	// records all input to a file, or replays input from a file in place of the keyboard and mouse, starting
+	// from the first frame. must be called before run(). a replay uses the recorded delta times with v-sync
+	// disabled so that it runs as fast as possible, and quits the application when it finishes
+	void recordInput(const char* filename) { m_recordFilename = filename; }
+	void replayInput(const char* filename) { m_replayFilename = filename; }
+
+	// saves every frame from the first, to a raw video if the path ends in .y4m and otherwise to numbered
+	// PNG images starting with the path, without any .png extension it has, so frames.png writes
+	// frames_000000.png onwards. must be called before run(). frames are read back and written
+	// in the background, and are dropped rather than slowing the application if that falls behind
+	void captureFrames(const char* path, unsigned int framesPerSecond = 60) {
+		m_captureFilename = path;
+		m_captureFramesPerSecond = framesPerSecond;
+	}
+
 	// access to the GLFW window
 	GLFWwindow* getWindowPtr() const { return m_window; }
 
@@ -67,6 +86,13 @@ protected:
 	
 	unsigned int	m_fps;
 
+	std::string		m_recordFilename;
+	std::string		m_replayFilename;
+
+	std::string		m_captureFilename;
+	unsigned int	m_captureFramesPerSecond;
+	FrameCapture*	m_capture;
+
 };
 
 } // namespace aie
\ No newline at end of file
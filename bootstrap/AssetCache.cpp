@@ -0,0 +1,156 @@
+#include "gl_core_4_4.h"
+#include "AssetCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <direct.h>
+
+namespace aie {
+
+std::string AssetCache::sm_directory = "./cache";
+
+// the path of a key's blob, such as ./cache/texture_0123456789abcdef.bin
+static std::string blobPath(const std::string& directory, const char* type, unsigned long long key) {
+	char name[64];
+	sprintf_s(name, 64, "/%s_%016llx.bin", type, key);
+	return directory + name;
+}
+
+void AssetCache::setDirectory(const char* path) {
+	sm_directory = path != nullptr ? path : "";
+}
+
+unsigned long long AssetCache::hash(const void* data, size_t size, unsigned long long seed) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i) {
+		seed ^= bytes[i];
+		seed *= 1099511628211ull;
+	}
+	return seed;
+}
+
+unsigned long long AssetCache::hash(const char* str, unsigned long long seed) {
+	return hash(str, strlen(str), seed);
+}
+
+bool AssetCache::readFile(const char* filename, std::vector<unsigned char>& data) {
+
+	FILE* file = nullptr;
+	fopen_s(&file, filename, "rb");
+	if (file == nullptr)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size : 0);
+	bool read = size > 0 && fread(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+
+	return read;
+}
+
+bool AssetCache::load(const char* type, unsigned long long key, std::vector<unsigned char>& data) {
+
+	if (sm_directory.empty())
+		return false;
+
+	return readFile(blobPath(sm_directory, type, key).c_str(), data);
+}
+
+bool AssetCache::store(const char* type, unsigned long long key, const void* data, size_t size) {
+
+	if (sm_directory.empty())
+		return false;
+
+	// an existing directory is fine, anything else shows up as the file failing to open
+	_mkdir(sm_directory.c_str());
+
+	std::string path = blobPath(sm_directory, type, key);
+	std::string temporary = path + ".tmp";
+
+	FILE* file = nullptr;
+	fopen_s(&file, temporary.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	bool written = fwrite(data, 1, size, file) == size;
+	fclose(file);
+
+	// the blob only appears under its real name once it is complete
+	remove(path.c_str());
+	if (written == false ||
+		rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+unsigned long long AssetCache::programKey(unsigned long long key) {
+
+	// binaries only load on the driver that made them
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (renderer != nullptr)
+		key = hash(renderer, key);
+	if (version != nullptr)
+		key = hash(version, key);
+	return key;
+}
+
+unsigned int AssetCache::loadProgram(unsigned long long key) {
+
+	// glProgramBinary is only loaded if the driver supports GL 4.1 or ARB_get_program_binary
+	if (glProgramBinary == nullptr)
+		return 0;
+
+	std::vector<unsigned char> data;
+	if (load("program", programKey(key), data) == false ||
+		data.size() <= sizeof(unsigned int))
+		return 0;
+
+	unsigned int format = *(unsigned int*)data.data();
+
+	unsigned int program = glCreateProgram();
+	glProgramBinary(program, format, data.data() + sizeof(unsigned int), (int)(data.size() - sizeof(unsigned int)));
+
+	// a driver update can reject an old binary, in which case the program is built from source again
+	int success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void AssetCache::prepareProgram(unsigned int program) {
+	if (glProgramParameteri != nullptr)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void AssetCache::storeProgram(unsigned long long key, unsigned int program) {
+
+	if (glGetProgramBinary == nullptr ||
+		sm_directory.empty())
+		return;
+
+	int success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (success == GL_FALSE ||
+		length <= 0)
+		return;
+
+	// the blob is the binary's format followed by the binary
+	std::vector<unsigned char> data(sizeof(unsigned int) + length);
+	unsigned int format = 0;
+	glGetProgramBinary(program, length, nullptr, &format, data.data() + sizeof(unsigned int));
+	*(unsigned int*)data.data() = format;
+
+	store("program", programKey(key), data.data(), data.size());
+}
+
+} // namespace aie
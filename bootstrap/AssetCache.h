@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace aie {
+
+// a directory of blobs built from assets on an earlier run, such as decoded textures, baked font
+// atlases and linked shader program binaries. each blob is named by a type and a hash of everything
+// it was built from, so a changed asset gets a new blob rather than a stale one. the directory is
+// created when something is stored, and deleting it only makes the next launch slower. loading and
+// storing are safe from any thread, but setDirectory isn't
+class AssetCache {
+public:
+
+	// "./cache" by default. an empty path turns the cache off
+	static void			setDirectory(const char* path);
+	static const std::string& getDirectory() { return sm_directory; }
+
+	// a 64-bit FNV-1a hash, which can be chained by passing a previous hash as the seed
+	static unsigned long long	hash(const void* data, size_t size, unsigned long long seed = 14695981039346656037ull);
+	static unsigned long long	hash(const char* str, unsigned long long seed = 14695981039346656037ull);
+
+	// reads the blob stored for a key, returning false if there isn't one
+	static bool			load(const char* type, unsigned long long key, std::vector<unsigned char>& data);
+
+	// writes a blob for a key. the blob is written to a temporary file first so a crash can't leave half of one
+	static bool			store(const char* type, unsigned long long key, const void* data, size_t size);
+
+	// reads a whole file, which is hashed for the key of anything built from it
+	static bool			readFile(const char* filename, std::vector<unsigned char>& data);
+
+	// creates a program from its stored binary, returning 0 if there isn't one or the driver rejects it.
+	// the key should hash the program's sources, and the driver's name and version are added to it
+	static unsigned int	loadProgram(unsigned long long key);
+
+	// stores the binary of a linked program. the program should be linked after calling prepareProgram
+	static void			storeProgram(unsigned long long key, unsigned int program);
+	static void			prepareProgram(unsigned int program);
+
+private:
+
+	static unsigned long long	programKey(unsigned long long key);
+
+	static std::string	sm_directory;
+};
+
+} // namespace aie
@@ -0,0 +1,78 @@
+#include "Counters.h"
+#include <stdio.h>
+
+namespace aie {
+
+std::vector<std::string> Counters::sm_names;
+std::vector<unsigned int> Counters::sm_values;
+std::vector<unsigned int> Counters::sm_lastStep;
+std::vector<Counters::StepRecord> Counters::sm_history;
+unsigned int Counters::sm_stepCount = 0;
+bool Counters::sm_recording = false;
+
+unsigned int Counters::registerCounter(const char* name) {
+
+	unsigned int id = findCounter(name);
+	if (id != INVALID_ID)
+		return id;
+
+	sm_names.push_back(name);
+	sm_values.push_back(0);
+	sm_lastStep.push_back(0);
+
+	return (unsigned int)sm_names.size() - 1;
+}
+
+unsigned int Counters::findCounter(const char* name) {
+
+	for (unsigned int i = 0; i < sm_names.size(); ++i) {
+		if (sm_names[i] == name)
+			return i;
+	}
+	return INVALID_ID;
+}
+
+void Counters::endStep() {
+
+	if (sm_recording) {
+		StepRecord record;
+		record.step = sm_stepCount;
+		record.values = sm_values;
+		sm_history.push_back(std::move(record));
+	}
+
+	sm_lastStep = sm_values;
+	for (auto& value : sm_values)
+		value = 0;
+
+	sm_stepCount++;
+}
+
+void Counters::clearHistory() {
+	sm_history.clear();
+}
+
+bool Counters::exportCSV(const char* filename) {
+
+	FILE* file = nullptr;
+	fopen_s(&file, filename, "w");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "step");
+	for (auto& name : sm_names)
+		fprintf(file, ",%s", name.c_str());
+	fprintf(file, "\n");
+
+	for (auto& record : sm_history) {
+		fprintf(file, "%u", record.step);
+		for (unsigned int i = 0; i < sm_names.size(); ++i)
+			fprintf(file, ",%u", i < record.values.size() ? record.values[i] : 0);
+		fprintf(file, "\n");
+	}
+
+	fclose(file);
+	return true;
+}
+
+} // namespace aie
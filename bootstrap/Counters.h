@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+namespace aie {
+
+// a registry of named integer counters that systems increment as they work.
+// values accumulate until endStep() is called, at which point they are stored
+// as that step's totals (and optionally appended to a history that can be
+// exported as a CSV time series) and reset to zero
+class Counters {
+public:
+
+	// registers a counter and returns its id. registering an existing name returns the existing id
+	static unsigned int	registerCounter(const char* name);
+
+	// returns the id of a registered counter, or INVALID_ID if no counter has that name
+	static unsigned int	findCounter(const char* name);
+
+	// adds to a counter for the current step
+	static void			increment(unsigned int id, unsigned int amount = 1) { sm_values[id] += amount; }
+
+	// closes the current step, storing its totals and resetting all counters to zero
+	static void			endStep();
+
+	// the value accumulated so far in the current step, and the total of the last completed step
+	static unsigned int	getValue(unsigned int id) { return sm_values[id]; }
+	static unsigned int	getLastStepValue(unsigned int id) { return sm_lastStep[id]; }
+
+	static unsigned int			getCounterCount() { return (unsigned int)sm_names.size(); }
+	static const std::string&	getCounterName(unsigned int id) { return sm_names[id]; }
+
+	// number of steps completed since startup
+	static unsigned int	getStepCount() { return sm_stepCount; }
+
+	// when recording, every completed step is appended to the history for exporting
+	static void			setRecording(bool recording) { sm_recording = recording; }
+	static bool			isRecording() { return sm_recording; }
+	static void			clearHistory();
+
+	// writes the recorded history as CSV, one row per step and one column per counter
+	static bool			exportCSV(const char* filename);
+
+	enum : unsigned int { INVALID_ID = 0xFFFFFFFF };
+
+private:
+
+	// a completed step in the history, counters registered after the step was recorded are implicitly 0
+	struct StepRecord {
+		unsigned int				step;
+		std::vector<unsigned int>	values;
+	};
+
+	static std::vector<std::string>		sm_names;
+	static std::vector<unsigned int>	sm_values;
+	static std::vector<unsigned int>	sm_lastStep;
+	static std::vector<StepRecord>		sm_history;
+	static unsigned int					sm_stepCount;
+	static bool							sm_recording;
+};
+
+} // namespace aie
@@ -1,171 +1,356 @@
 #include "gl_core_4_4.h"
+#include "GLState.h"
 #include "Font.h"
+#include "AssetCache.h"
 #include <stdio.h>
+#include <vector>
+#include <cmath>
+#include <cfloat>
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
 namespace aie {
 
-Font::Font(const char* trueTypeFontFile, unsigned short fontHeight) 
-	: m_glyphData(nullptr),
-	m_glHandle(0),
-	m_pixelBufferHandle(0),
-	m_textureWidth(0),
-	m_textureHeight(0) {
-	
-	FILE* file = nullptr;
-	fopen_s(&file, trueTypeFontFile, "rb");
-	if (file != nullptr) {
-		
-		unsigned char* ttf_buffer = new unsigned char[4096 * 1024];
-
-		fread(ttf_buffer, 1, 4096 * 1024, file);
-		fclose(file);
-
-		// determine size of texture image
-		m_textureWidth = fontHeight / 16 * 256;
-		m_textureHeight = fontHeight / 16 * 256;
-
-		if (fontHeight <= 16) {
-			m_textureWidth = 256;
-			m_textureHeight = 256;
+// squared distance along a row or column to the nearest feature, where features are 0 in f and
+// everything else is FLT_MAX. this is the lower envelope of parabolas from Felzenszwalb and Huttenlocher
+static void distanceTransform(const float* f, float* d, int n, int* v, float* z) {
+	int k = 0;
+	v[0] = 0;
+	z[0] = -FLT_MAX;
+	z[1] = FLT_MAX;
+
+	for (int q = 1; q < n; ++q) {
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+		while (s <= z[k]) {
+			k--;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
 		}
-		
-		if (m_textureWidth > 2048)
-			m_textureWidth = 2048;
-		if (m_textureHeight > 2048)
-			m_textureHeight = 2048;
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = FLT_MAX;
+	}
 
-		glGenBuffers(1, &m_pixelBufferHandle);
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBufferHandle);
-		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_textureWidth * m_textureHeight, nullptr, GL_STREAM_COPY);
-		unsigned char* tempBitmapData = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 
-																   m_textureWidth * m_textureHeight,
-																   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	k = 0;
+	for (int q = 0; q < n; ++q) {
+		while (z[k + 1] < q)
+			k++;
+		d[q] = (float)((q - v[k]) * (q - v[k])) + f[v[k]];
+	}
+}
 
-		m_glyphData = new stbtt_bakedchar[256];
-		memset(m_glyphData, 0, sizeof(stbtt_bakedchar) * 256);
-		stbtt_BakeFontBitmap(ttf_buffer, 0, fontHeight, tempBitmapData, m_textureWidth, m_textureHeight, 0, 256, (stbtt_bakedchar*)m_glyphData);
+// the distance from each pixel of a width x height grid to the nearest pixel that is set in inside
+static void distanceTransform2D(const std::vector<bool>& inside, int width, int height, std::vector<float>& distances) {
 
-		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	int size = width > height ? width : height;
+	std::vector<float> f(size), d(size), z(size + 1);
+	std::vector<int> v(size);
 
-		glGenTextures(1, &m_glHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	distances.resize(width * height);
+	for (int i = 0; i < width * height; ++i)
+		distances[i] = inside[i] ? 0.0f : FLT_MAX;
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_textureWidth, m_textureHeight, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	// the squared distance transform separates into columns then rows
+	for (int x = 0; x < width; ++x) {
+		for (int y = 0; y < height; ++y)
+			f[y] = distances[y * width + x];
+		distanceTransform(f.data(), d.data(), height, v.data(), z.data());
+		for (int y = 0; y < height; ++y)
+			distances[y * width + x] = d[y];
+	}
+	for (int y = 0; y < height; ++y) {
+		distanceTransform(&distances[y * width], d.data(), width, v.data(), z.data());
+		for (int x = 0; x < width; ++x)
+			distances[y * width + x] = std::sqrt(d[x]);
+	}
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+Font::Font(const char* trueTypeFontFile, unsigned short fontHeight, bool distanceField) 
+	: m_glyphData(nullptr),
+	m_glHandle(0),
+	m_textureWidth(0),
+	m_textureHeight(0),
+	m_typeface(nullptr),
+	m_distanceField(distanceField),
+	m_bakedHeight(distanceField ? (unsigned short)DISTANCE_FIELD_HEIGHT : fontHeight),
+	m_scale(1.0f) {
+
+	if (distanceField)
+		m_scale = fontHeight / m_bakedHeight;
+
+	std::vector<unsigned char> ttf;
+	if (AssetCache::readFile(trueTypeFontFile, ttf) == false)
+		return;
+
+	// the baked texture and glyphs are cached under a hash of the font file and the size it was baked at
+	unsigned long long key = AssetCache::hash(ttf.data(), ttf.size());
+	key = AssetCache::hash(&m_bakedHeight, sizeof(m_bakedHeight), key);
+	key = AssetCache::hash(&m_distanceField, sizeof(m_distanceField), key);
+
+	std::vector<unsigned char> pixels;
+	if (loadBaked(key, pixels) == false) {
+
+		if (distanceField == false)
+			bakeBitmap(ttf.data(), fontHeight, pixels);
+		else if (bakeDistanceField(ttf.data(), pixels) == false)
+			return;
+		storeBaked(key, pixels);
+	}
 
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glGenTextures(1, &m_glHandle);
+	GLState::bindTexture(m_glHandle);
 
-		delete[] ttf_buffer;
-	}
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_textureWidth, m_textureHeight, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+
+	// distance field glyphs are spread to their edges, so they mustn't bleed across the texture
+	GLenum wrap = distanceField ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
+
+Font::Font(Font* typeface, unsigned short fontHeight)
+	: m_glyphData(typeface->m_glyphData),
+	m_glHandle(typeface->m_glHandle),
+	m_textureWidth(typeface->m_textureWidth),
+	m_textureHeight(typeface->m_textureHeight),
+	m_typeface(typeface),
+	m_distanceField(typeface->m_distanceField),
+	m_bakedHeight(0),
+	m_scale(1.0f) {
+
+	m_bakedHeight = typeface->m_bakedHeight;
+	m_scale = fontHeight / m_bakedHeight;
 }
 
 Font::~Font() {
+
+	// glyphs and texture shared from another font are freed by it
+	if (m_typeface != nullptr)
+		return;
+
 	delete[] (stbtt_bakedchar*)m_glyphData;
 
-	glDeleteTextures(1, &m_glHandle);
-	glDeleteBuffers(1, &m_pixelBufferHandle);
+	GLState::deleteTextures(1, &m_glHandle);
 }
 
-float Font::getStringWidth(const char* str) {
+bool Font::loadBaked(unsigned long long key, std::vector<unsigned char>& pixels) {
 
-	stbtt_aligned_quad Q = {};
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	// the blob is the texture size, then the glyphs, then the texture's pixels
+	std::vector<unsigned char> blob;
+	size_t header = sizeof(unsigned int) * 2 + sizeof(stbtt_bakedchar) * 256;
+	if (AssetCache::load("font", key, blob) == false ||
+		blob.size() <= header)
+		return false;
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	const unsigned int* size = (const unsigned int*)blob.data();
+	if (size[0] == 0 || size[0] > 0xffff ||
+		size[1] == 0 || size[1] > 0xffff ||
+		blob.size() != header + (size_t)size[0] * size[1])
+		return false;
 
-		str++;
-	}
+	m_textureWidth = (unsigned short)size[0];
+	m_textureHeight = (unsigned short)size[1];
+
+	m_glyphData = new stbtt_bakedchar[256];
+	memcpy(m_glyphData, blob.data() + sizeof(unsigned int) * 2, sizeof(stbtt_bakedchar) * 256);
 
-	// get the position of the last vert for the last character rendered
-	return Q.x1;
+	pixels.assign(blob.begin() + header, blob.end());
+	return true;
 }
 
-float Font::getStringHeight(const char* str) {
+void Font::storeBaked(unsigned long long key, const std::vector<unsigned char>& pixels) const {
+
+	unsigned int size[2] = { m_textureWidth, m_textureHeight };
 
-	stbtt_aligned_quad Q = {};
-	float low = 9999999, high = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	std::vector<unsigned char> blob(sizeof(size) + sizeof(stbtt_bakedchar) * 256 + pixels.size());
+	memcpy(blob.data(), size, sizeof(size));
+	memcpy(blob.data() + sizeof(size), m_glyphData, sizeof(stbtt_bakedchar) * 256);
+	memcpy(blob.data() + sizeof(size) + sizeof(stbtt_bakedchar) * 256, pixels.data(), pixels.size());
+
+	AssetCache::store("font", key, blob.data(), blob.size());
+}
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+void Font::bakeBitmap(const unsigned char* ttfBuffer, unsigned short fontHeight, std::vector<unsigned char>& pixels) {
 
-		low = low > Q.y0 ? Q.y0 : low;
-		high = high < Q.y1 ? Q.y1 : high;
+	// determine size of texture image
+	m_textureWidth = fontHeight / 16 * 256;
+	m_textureHeight = fontHeight / 16 * 256;
 
-		str++;
+	if (fontHeight <= 16) {
+		m_textureWidth = 256;
+		m_textureHeight = 256;
 	}
 
-	return high - low;
+	if (m_textureWidth > 2048)
+		m_textureWidth = 2048;
+	if (m_textureHeight > 2048)
+		m_textureHeight = 2048;
+
+	pixels.assign(m_textureWidth * m_textureHeight, 0);
+
+	m_glyphData = new stbtt_bakedchar[256];
+	memset(m_glyphData, 0, sizeof(stbtt_bakedchar) * 256);
+	stbtt_BakeFontBitmap(ttfBuffer, 0, fontHeight, pixels.data(), m_textureWidth, m_textureHeight, 0, 256, (stbtt_bakedchar*)m_glyphData);
 }
 
-void Font::getStringSize(const char* str, float& width, float& height) {
+bool Font::bakeDistanceField(const unsigned char* ttfBuffer, std::vector<unsigned char>& pixels) {
 
-	stbtt_aligned_quad Q = {};
-	float low = 9999999, high = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	stbtt_fontinfo info;
+	if (stbtt_InitFont(&info, ttfBuffer, stbtt_GetFontOffsetForIndex(ttfBuffer, 0)) == 0)
+		return false;
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	float scale = stbtt_ScaleForPixelHeight(&info, (float)DISTANCE_FIELD_HEIGHT);
+	int spread = DISTANCE_FIELD_SPREAD;
 
-		low = low > Q.y0 ? Q.y0 : low;
-		high = high < Q.y1 ? Q.y1 : high;
+	m_glyphData = new stbtt_bakedchar[256];
+	stbtt_bakedchar* glyphs = (stbtt_bakedchar*)m_glyphData;
+	memset(glyphs, 0, sizeof(stbtt_bakedchar) * 256);
 
-		str++;
+	// render each glyph's coverage, padded by the spread so the field can fade out around it
+	std::vector<std::vector<unsigned char>> fields(256);
+	std::vector<int> widths(256, 0), heights(256, 0);
+
+	for (int c = 0; c < 256; ++c) {
+
+		int advance = 0, bearing = 0;
+		stbtt_GetCodepointHMetrics(&info, c, &advance, &bearing);
+		glyphs[c].xadvance = advance * scale;
+
+		int width = 0, height = 0, xoff = 0, yoff = 0;
+		unsigned char* bitmap = stbtt_GetCodepointBitmap(&info, scale, scale, c, &width, &height, &xoff, &yoff);
+		if (bitmap == nullptr ||
+			width == 0 ||
+			height == 0) {
+			stbtt_FreeBitmap(bitmap, nullptr);
+			continue;
+		}
+
+		int paddedWidth = width + spread * 2;
+		int paddedHeight = height + spread * 2;
+		std::vector<bool> inside(paddedWidth * paddedHeight, false);
+		std::vector<bool> outside(paddedWidth * paddedHeight, true);
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				bool set = bitmap[y * width + x] >= 128;
+				inside[(y + spread) * paddedWidth + x + spread] = set;
+				outside[(y + spread) * paddedWidth + x + spread] = !set;
+			}
+		}
+		stbtt_FreeBitmap(bitmap, nullptr);
+
+		// the signed distance to the outline, stored with the outline at 0.5 and the spread at 0 and 1
+		std::vector<float> toInside, toOutside;
+		distanceTransform2D(inside, paddedWidth, paddedHeight, toInside);
+		distanceTransform2D(outside, paddedWidth, paddedHeight, toOutside);
+
+		std::vector<unsigned char>& field = fields[c];
+		field.resize(paddedWidth * paddedHeight);
+		for (int i = 0; i < paddedWidth * paddedHeight; ++i) {
+			float distance = inside[i] ? toOutside[i] - 0.5f : 0.5f - toInside[i];
+			float value = 0.5f + distance / (spread * 2.0f);
+			field[i] = (unsigned char)(value < 0 ? 0 : value > 1 ? 255 : value * 255.0f + 0.5f);
+		}
+
+		widths[c] = paddedWidth;
+		heights[c] = paddedHeight;
+		glyphs[c].xoff = (float)(xoff - spread);
+		glyphs[c].yoff = (float)(yoff - spread);
 	}
 
-	height = high - low;
-	width = Q.x1;
+	// pack the glyphs into rows, then make the texture tall enough for them
+	m_textureWidth = 1024;
+	int x = 0, y = 0, rowHeight = 0;
+	for (int c = 0; c < 256; ++c) {
+		if (widths[c] == 0)
+			continue;
+		if (x + widths[c] > m_textureWidth) {
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+		glyphs[c].x0 = (unsigned short)x;
+		glyphs[c].y0 = (unsigned short)y;
+		glyphs[c].x1 = (unsigned short)(x + widths[c]);
+		glyphs[c].y1 = (unsigned short)(y + heights[c]);
+		x += widths[c];
+		rowHeight = rowHeight > heights[c] ? rowHeight : heights[c];
+	}
+
+	m_textureHeight = 64;
+	while (m_textureHeight < y + rowHeight)
+		m_textureHeight *= 2;
+
+	pixels.assign(m_textureWidth * m_textureHeight, 0);
+	for (int c = 0; c < 256; ++c) {
+		for (int row = 0; row < heights[c]; ++row)
+			memcpy(&pixels[(glyphs[c].y0 + row) * m_textureWidth + glyphs[c].x0], &fields[c][row * widths[c]], widths[c]);
+	}
+	return true;
+}
+
+void Font::layoutGlyph(unsigned char character, float& xPos, TextLayout::Glyph& glyph) const {
+
+	// glyphs drawn at the size they were baked at keep stb_truetype's pixel aligned placement
+	if (m_distanceField == false &&
+		m_scale == 1.0f) {
+		stbtt_aligned_quad Q = {};
+		float yPos = 0.0f;
+		stbtt_GetBakedQuad((stbtt_bakedchar*)m_glyphData, m_textureWidth, m_textureHeight, character, &xPos, &yPos, &Q, 1);
+		glyph = { Q.x0, Q.y0, Q.x1, Q.y1, Q.s0, Q.t0, Q.s1, Q.t1 };
+		return;
+	}
+
+	const stbtt_bakedchar& baked = ((stbtt_bakedchar*)m_glyphData)[character];
+	glyph.x0 = xPos + baked.xoff * m_scale;
+	glyph.y0 = baked.yoff * m_scale;
+	glyph.x1 = glyph.x0 + (baked.x1 - baked.x0) * m_scale;
+	glyph.y1 = glyph.y0 + (baked.y1 - baked.y0) * m_scale;
+	glyph.s0 = baked.x0 / (float)m_textureWidth;
+	glyph.t0 = baked.y0 / (float)m_textureHeight;
+	glyph.s1 = baked.x1 / (float)m_textureWidth;
+	glyph.t1 = baked.y1 / (float)m_textureHeight;
+	xPos += baked.xadvance * m_scale;
+}
+
+float Font::getStringWidth(const char* str) {
+	return getLayout(str).getWidth();
+}
+
+float Font::getStringHeight(const char* str) {
+	return getLayout(str).getHeight();
+}
+
+void Font::getStringSize(const char* str, float& width, float& height) {
+	const TextLayout& layout = getLayout(str);
+	width = layout.getWidth();
+	height = layout.getHeight();
 }
 
 void Font::getStringRectangle(const char* str, float& x0, float& y0, float& x1, float& y1) {
 
-	stbtt_aligned_quad Q = {};
-	y1 = 9999999, y0 = -9999999;
-	x0 = 9999999, x1 = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	float minY = 0, maxY = 0;
+	getLayout(str).getBounds(x0, minY, x1, maxY);
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	y0 = -maxY;
+	y1 = -minY;
+}
 
-		y1 = y1 > Q.y0 ? Q.y0 : y1;
-		y0 = y0 < Q.y1 ? Q.y1 : y0;
+const TextLayout& Font::getLayout(const char* str) {
 
-		x1 = x1 < Q.x1 ? Q.x1 : x1;
-		x0 = x0 > Q.x0 ? Q.x0 : x0;
+	auto iter = m_layouts.find(str);
+	if (iter != m_layouts.end())
+		return iter->second;
 
-		str++;
-	}
+	// strings that change every frame would otherwise fill the cache forever
+	if (m_layouts.size() >= MAX_CACHED_LAYOUTS)
+		m_layouts.clear();
 
-	y0 *= -1;
-	y1 *= -1;
+	TextLayout& layout = m_layouts[str];
+	layout.set(this, str);
+	return layout;
 }
 
 } // namepace aie
\ No newline at end of file
@@ -1,20 +1,33 @@
 #pragma once
 
+#include "TextLayout.h"
+#include <unordered_map>
+#include <vector>
+
 namespace aie {
 
 // a class that wraps up a True Type Font within an OpenGL texture
 class Font {
 
 	friend class Renderer2D;
+	friend class TextLayout;
 
 public:
 
-	Font(const char* trueTypeFontFile, unsigned short fontHeight);
+	// a distance field font bakes its glyphs once at a fixed size, and can be drawn
+	// clearly at any other size by creating more fonts from it
+	Font(const char* trueTypeFontFile, unsigned short fontHeight, bool distanceField = false);
+
+	// a font that draws another font's glyphs at a different height, sharing its texture.
+	// the other font must outlive it, and should be a distance field font to stay sharp
+	Font(Font* typeface, unsigned short fontHeight);
 	~Font();
 
 	// returns the OpenGL texture handle
 	unsigned int	getTextureHandle() const { return m_glHandle; }
 
+	bool			isDistanceField() const { return m_distanceField; }
+
 	// returns size of string using this font
 	float getStringWidth(const char* str);
 
@@ -25,11 +38,41 @@ public:
 	// returns a rectangle that fits the string, with x0y0 being bottom left, x1y1 top right
 	void getStringRectangle(const char* str, float& x0, float& y0, float& x1, float& y1);
 
+	// returns the cached layout of a string, laying it out the first time it is used. the cache is
+	// emptied when it fills, so the layout is only valid until the next call
+	const TextLayout& getLayout(const char* str);
+
 private:
 
+	// positions a glyph at the pen position and moves the pen on, scaling the baked glyph to the font height
+	void layoutGlyph(unsigned char character, float& xPos, TextLayout::Glyph& glyph) const;
+
+	// bake the glyphs into the pixels of a single channel texture
+	void bakeBitmap(const unsigned char* ttfBuffer, unsigned short fontHeight, std::vector<unsigned char>& pixels);
+	bool bakeDistanceField(const unsigned char* ttfBuffer, std::vector<unsigned char>& pixels);
+
+	// read and write the glyphs and texture pixels from the asset cache
+	bool loadBaked(unsigned long long key, std::vector<unsigned char>& pixels);
+	void storeBaked(unsigned long long key, const std::vector<unsigned char>& pixels) const;
+
+	// distance field glyphs are baked at this height, with this many pixels of distance around them
+	enum { DISTANCE_FIELD_HEIGHT = 48, DISTANCE_FIELD_SPREAD = 6 };
+
+	enum { MAX_CACHED_LAYOUTS = 256 };
+
+	std::unordered_map<std::string, TextLayout>	m_layouts;
+
 	void*			m_glyphData;
-	unsigned int	m_glHandle, m_pixelBufferHandle;
+	unsigned int	m_glHandle;
 	unsigned short	m_textureWidth, m_textureHeight;
+
+	// the font the glyphs and texture belong to, or nullptr if they are this font's own
+	Font*			m_typeface;
+	bool			m_distanceField;
+
+	// the height the glyphs were baked at, and how much they are scaled by to draw at this font's height
+	float			m_bakedHeight;
+	float			m_scale;
 };
 
 } // namespace aie
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "gl_core_4_4.h"
+#include "FrameCapture.h"
+#include <string.h>
+#include <algorithm>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace aie {
+
+FrameCapture::FrameCapture(const char* path, Format format, unsigned int framesPerSecond, unsigned int bufferCount)
+	: m_path(path),
+	m_format(format),
+	m_framesPerSecond(framesPerSecond),
+	m_next(0),
+	m_oldest(0),
+	m_frame(0),
+	m_captured(0),
+	m_dropped(0),
+	m_quit(false),
+	m_video(nullptr),
+	m_videoWidth(0),
+	m_videoHeight(0) {
+
+	m_slots.resize(bufferCount < 2 ? 2 : bufferCount);
+	for (auto& slot : m_slots) {
+		glGenBuffers(1, &slot.buffer);
+		slot.fence = nullptr;
+		slot.width = slot.height = 0;
+		slot.size = 0;
+		slot.index = 0;
+	}
+
+	// a video is written in order by one worker, images can be written by several at once
+	unsigned int count = 1;
+	if (format == PNG) {
+		count = std::thread::hardware_concurrency();
+		count = count > 1 ? std::min(count - 1, 3u) : 1;
+	}
+	for (unsigned int i = 0; i < count; ++i)
+		m_workers.push_back(std::thread(&FrameCapture::work, this));
+}
+
+FrameCapture::~FrameCapture() {
+
+	// wait for the readbacks still in flight, oldest first
+	for (unsigned int i = 0; i < m_slots.size(); ++i) {
+		Slot& slot = m_slots[m_oldest];
+		if (slot.fence != nullptr) {
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			collect(slot);
+		}
+		m_oldest = (m_oldest + 1) % m_slots.size();
+	}
+
+	// the workers finish the queue before they stop
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_condition.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+
+	for (auto frame : m_free)
+		delete frame;
+	for (auto& slot : m_slots)
+		glDeleteBuffers(1, &slot.buffer);
+
+	if (m_video != nullptr)
+		fclose(m_video);
+}
+
+void FrameCapture::capture(unsigned int width, unsigned int height) {
+
+	// hand over the frames the GPU has finished copying, which complete in the order they were read
+	while (m_slots[m_oldest].fence != nullptr) {
+		GLenum result = glClientWaitSync(m_slots[m_oldest].fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED &&
+			result != GL_CONDITION_SATISFIED)
+			break;
+		collect(m_slots[m_oldest]);
+		m_oldest = (m_oldest + 1) % m_slots.size();
+	}
+
+	if (width == 0 ||
+		height == 0)
+		return;
+
+	// every buffer is still being copied into, so skip this frame rather than wait for the GPU
+	Slot& slot = m_slots[m_next];
+	if (slot.fence != nullptr) {
+		m_dropped++;
+		m_frame++;
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+	size_t size = (size_t)width * height * 4;
+	if (slot.size != size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.size = size;
+	}
+
+	// with a pack buffer bound glReadPixels only queues the copy and returns
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = width;
+	slot.height = height;
+	slot.index = m_frame++;
+
+	m_next = (m_next + 1) % m_slots.size();
+}
+
+void FrameCapture::collect(Slot& slot) {
+
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	Frame* frame = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_queue.size() < MAX_QUEUED_FRAMES) {
+			if (m_free.empty())
+				frame = new Frame();
+			else {
+				frame = m_free.back();
+				m_free.pop_back();
+			}
+		}
+	}
+
+	// the workers are too far behind to take another frame
+	if (frame == nullptr) {
+		m_dropped++;
+		return;
+	}
+
+	frame->width = slot.width;
+	frame->height = slot.height;
+	frame->index = slot.index;
+	frame->pixels.resize(slot.size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+	if (mapped != nullptr) {
+		memcpy(frame->pixels.data(), mapped, slot.size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (mapped != nullptr) {
+		m_queue.push_back(frame);
+		m_condition.notify_one();
+		m_captured++;
+	}
+	else {
+		m_free.push_back(frame);
+		m_dropped++;
+	}
+}
+
+void FrameCapture::work() {
+
+	while (true) {
+
+		Frame* frame = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_quit || m_queue.empty() == false; });
+			if (m_queue.empty())
+				return;
+
+			frame = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		if (m_format == PNG)
+			writePNG(*frame);
+		else
+			writeY4M(*frame);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_free.push_back(frame);
+	}
+}
+
+void FrameCapture::writePNG(Frame& frame) {
+
+	char filename[512];
+	sprintf_s(filename, 512, "%s_%06u.png", m_path.c_str(), frame.index);
+
+	// the back buffer's alpha is whatever blending left in it, which would make the image see-through
+	for (size_t i = 3; i < frame.pixels.size(); i += 4)
+		frame.pixels[i] = 255;
+
+	// starting from the last row with a negative stride writes the image top row first
+	int stride = frame.width * 4;
+	const unsigned char* top = frame.pixels.data() + (size_t)(frame.height - 1) * stride;
+	if (stbi_write_png(filename, frame.width, frame.height, 4, top, -stride) == 0)
+		printf("Error: Failed to write captured frame %s\n", filename);
+}
+
+void FrameCapture::writeY4M(const Frame& frame) {
+
+	if (m_video == nullptr) {
+		fopen_s(&m_video, m_path.c_str(), "wb");
+		if (m_video == nullptr) {
+			printf("Error: Failed to open capture video %s\n", m_path.c_str());
+			return;
+		}
+
+		// the stream's size is fixed by its header, so frames after the window is resized are skipped
+		m_videoWidth = frame.width;
+		m_videoHeight = frame.height;
+		fprintf(m_video, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", m_videoWidth, m_videoHeight, m_framesPerSecond);
+	}
+
+	if (frame.width != m_videoWidth ||
+		frame.height != m_videoHeight)
+		return;
+
+	// BT.601 luma for every pixel and chroma for every 2x2 block, with the rows flipped to start at the top
+	unsigned int width = frame.width, height = frame.height;
+	unsigned int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	m_planes.resize(width * height + chromaWidth * chromaHeight * 2);
+
+	unsigned char* yPlane = m_planes.data();
+	unsigned char* uPlane = yPlane + width * height;
+	unsigned char* vPlane = uPlane + chromaWidth * chromaHeight;
+
+	for (unsigned int y = 0; y < height; ++y) {
+		const unsigned char* row = frame.pixels.data() + (size_t)(height - 1 - y) * width * 4;
+		for (unsigned int x = 0; x < width; ++x) {
+			const unsigned char* p = row + x * 4;
+			yPlane[y * width + x] = (unsigned char)((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) / 256 + 16);
+		}
+	}
+
+	for (unsigned int y = 0; y < chromaHeight; ++y) {
+		for (unsigned int x = 0; x < chromaWidth; ++x) {
+
+			// average the block, which is smaller on an odd edge
+			int r = 0, g = 0, b = 0, count = 0;
+			for (unsigned int by = y * 2; by < y * 2 + 2 && by < height; ++by) {
+				for (unsigned int bx = x * 2; bx < x * 2 + 2 && bx < width; ++bx) {
+					const unsigned char* p = frame.pixels.data() + ((size_t)(height - 1 - by) * width + bx) * 4;
+					r += p[0];
+					g += p[1];
+					b += p[2];
+					count++;
+				}
+			}
+			r /= count;
+			g /= count;
+			b /= count;
+
+			uPlane[y * chromaWidth + x] = (unsigned char)((-38 * r - 74 * g + 112 * b + 128) / 256 + 128);
+			vPlane[y * chromaWidth + x] = (unsigned char)((112 * r - 94 * g - 18 * b + 128) / 256 + 128);
+		}
+	}
+
+	fputs("FRAME\n", m_video);
+	fwrite(m_planes.data(), 1, m_planes.size(), m_video);
+}
+
+} // namespace aie
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+// matches GLsync from gl_core_4_4.h without including it
+struct __GLsync;
+
+namespace aie {
+
+// saves every frame drawn to the back buffer, as numbered PNG images or a raw Y4M video. each frame is
+// read into the next of a ring of pixel buffers and fenced, and is only mapped once the GPU has finished
+// the copy, so the frame loop never waits on glReadPixels. worker threads convert and write the frames.
+// if the GPU or the workers fall behind, frames are dropped instead of slowing the application down
+class FrameCapture {
+public:
+
+	enum Format {
+		PNG,	// path is a prefix, and frames are written to <path>_000000.png onwards
+		Y4M,	// path is the video file, which plays back at framesPerSecond
+	};
+
+	FrameCapture(const char* path, Format format, unsigned int framesPerSecond = 60, unsigned int bufferCount = 3);
+
+	// finishes reading back and writing the frames already captured
+	~FrameCapture();
+
+	// starts reading the back buffer into the next pixel buffer, and hands earlier frames that have
+	// finished reading back to the workers. call after drawing and before swapping buffers
+	void			capture(unsigned int width, unsigned int height);
+
+	unsigned int	getCapturedCount() const { return m_captured; }
+	unsigned int	getDroppedCount() const { return m_dropped; }
+
+private:
+
+	// the most frames waiting for a worker before new ones are dropped
+	enum { MAX_QUEUED_FRAMES = 8 };
+
+	struct Slot {
+		unsigned int	buffer;
+		__GLsync*		fence;		// nullptr when the slot is free
+		unsigned int	width, height;
+		size_t			size;		// bytes allocated for the buffer
+		unsigned int	index;		// the frame number being read into it
+	};
+
+	struct Frame {
+		std::vector<unsigned char>	pixels;		// RGBA, bottom row first
+		unsigned int				width, height;
+		unsigned int				index;
+	};
+
+	// maps a finished readback and queues it for the workers, or drops it if they are too far behind
+	void			collect(Slot& slot);
+
+	void			work();
+	void			writePNG(Frame& frame);
+	void			writeY4M(const Frame& frame);
+
+	std::string		m_path;
+	Format			m_format;
+	unsigned int	m_framesPerSecond;
+
+	std::vector<Slot>	m_slots;
+	unsigned int		m_next;		// the slot the next frame is read into
+	unsigned int		m_oldest;	// the slot that was read into longest ago
+
+	unsigned int	m_frame;
+	unsigned int	m_captured;
+	unsigned int	m_dropped;
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_mutex;
+	std::condition_variable		m_condition;
+	std::deque<Frame*>			m_queue;
+	std::vector<Frame*>			m_free;		// written frames, kept so their pixels needn't be allocated again
+	bool						m_quit;
+
+	// the video stream, with the size from its header. only written by its single worker
+	FILE*			m_video;
+	unsigned int	m_videoWidth, m_videoHeight;
+	std::vector<unsigned char>	m_planes;
+};
+
+} // namespace aie
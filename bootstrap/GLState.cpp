@@ -0,0 +1,232 @@
+#include "GLState.h"
+#include "gl_core_4_4.h"
+
+namespace aie {
+
+GLState::State GLState::sm_state = {};
+
+// turns a capability on or off
+static void setCapability(unsigned int capability, bool enabled) {
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void GLState::reset() {
+	int value = 0;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+	sm_state.program = (unsigned int)value;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);
+	sm_state.vertexArray = (unsigned int)value;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &value);
+	sm_state.arrayBuffer = (unsigned int)value;
+
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+	sm_state.activeTexture = (unsigned int)value - GL_TEXTURE0;
+	for (unsigned int i = 0; i < TEXTURE_UNITS; ++i) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+		sm_state.textures[i] = (unsigned int)value;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &value);
+		sm_state.textureArrays[i] = (unsigned int)value;
+	}
+	glActiveTexture(GL_TEXTURE0 + sm_state.activeTexture);
+
+	sm_state.blend = glIsEnabled(GL_BLEND) == GL_TRUE;
+	glGetIntegerv(GL_BLEND_SRC, &value);
+	sm_state.blendSrc = (unsigned int)value;
+	glGetIntegerv(GL_BLEND_DST, &value);
+	sm_state.blendDst = (unsigned int)value;
+	glGetIntegerv(GL_BLEND_EQUATION_RGB, &value);
+	sm_state.blendEquation = (unsigned int)value;
+
+	GLboolean depthMask = GL_TRUE;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	sm_state.depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+	sm_state.depthMask = depthMask == GL_TRUE;
+	glGetIntegerv(GL_DEPTH_FUNC, &value);
+	sm_state.depthFunc = (unsigned int)value;
+
+	sm_state.cullFace = glIsEnabled(GL_CULL_FACE) == GL_TRUE;
+	sm_state.scissorTest = glIsEnabled(GL_SCISSOR_TEST) == GL_TRUE;
+	glGetIntegerv(GL_VIEWPORT, sm_state.viewport);
+}
+
+void GLState::restore(const State& state) {
+	useProgram(state.program);
+	bindVertexArray(state.vertexArray);
+	bindArrayBuffer(state.arrayBuffer);
+	for (unsigned int i = 0; i < TEXTURE_UNITS; ++i) {
+		if (sm_state.textures[i] != state.textures[i])
+			bindTexture(state.textures[i], i);
+		if (sm_state.textureArrays[i] != state.textureArrays[i])
+			bindTextureArray(state.textureArrays[i], i);
+	}
+	setActiveTexture(state.activeTexture);
+
+	setBlend(state.blend);
+	setBlendFunc(state.blendSrc, state.blendDst);
+	setBlendEquation(state.blendEquation);
+	setDepthTest(state.depthTest);
+	setDepthMask(state.depthMask);
+	setDepthFunc(state.depthFunc);
+	setCullFace(state.cullFace);
+	setScissorTest(state.scissorTest);
+	setViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+}
+
+void GLState::useProgram(unsigned int program) {
+	if (sm_state.program != program) {
+		glUseProgram(program);
+		sm_state.program = program;
+	}
+}
+
+void GLState::bindVertexArray(unsigned int vertexArray) {
+	if (sm_state.vertexArray != vertexArray) {
+		glBindVertexArray(vertexArray);
+		sm_state.vertexArray = vertexArray;
+	}
+}
+
+void GLState::bindArrayBuffer(unsigned int buffer) {
+	if (sm_state.arrayBuffer != buffer) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		sm_state.arrayBuffer = buffer;
+	}
+}
+
+void GLState::bindTexture(unsigned int texture, unsigned int unit) {
+	// the unit is made active even when the texture is already bound, so glTex* calls that follow act on it
+	setActiveTexture(unit);
+	if (sm_state.textures[unit] != texture) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		sm_state.textures[unit] = texture;
+	}
+}
+
+void GLState::bindTextureArray(unsigned int texture, unsigned int unit) {
+	// the unit is made active even when the texture is already bound, so glTex* calls that follow act on it
+	setActiveTexture(unit);
+	if (sm_state.textureArrays[unit] != texture) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		sm_state.textureArrays[unit] = texture;
+	}
+}
+
+void GLState::setActiveTexture(unsigned int unit) {
+	if (sm_state.activeTexture != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		sm_state.activeTexture = unit;
+	}
+}
+
+void GLState::deletePrograms(int count, const unsigned int* programs) {
+	for (int i = 0; i < count; ++i) {
+		if (sm_state.program == programs[i])
+			useProgram(0);
+		glDeleteProgram(programs[i]);
+	}
+}
+
+void GLState::deleteVertexArrays(int count, const unsigned int* vertexArrays) {
+	for (int i = 0; i < count; ++i) {
+		if (vertexArrays[i] != 0 && sm_state.vertexArray == vertexArrays[i])
+			sm_state.vertexArray = 0;
+	}
+	glDeleteVertexArrays(count, vertexArrays);
+}
+
+void GLState::deleteBuffers(int count, const unsigned int* buffers) {
+	for (int i = 0; i < count; ++i) {
+		if (buffers[i] != 0 && sm_state.arrayBuffer == buffers[i])
+			sm_state.arrayBuffer = 0;
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void GLState::deleteTextures(int count, const unsigned int* textures) {
+	for (int i = 0; i < count; ++i) {
+		for (unsigned int& bound : sm_state.textures) {
+			if (textures[i] != 0 && bound == textures[i])
+				bound = 0;
+		}
+		for (unsigned int& bound : sm_state.textureArrays) {
+			if (textures[i] != 0 && bound == textures[i])
+				bound = 0;
+		}
+	}
+	glDeleteTextures(count, textures);
+}
+
+void GLState::setBlend(bool enabled) {
+	if (sm_state.blend != enabled) {
+		setCapability(GL_BLEND, enabled);
+		sm_state.blend = enabled;
+	}
+}
+
+void GLState::setBlendFunc(unsigned int src, unsigned int dst) {
+	if (sm_state.blendSrc != src || sm_state.blendDst != dst) {
+		glBlendFunc(src, dst);
+		sm_state.blendSrc = src;
+		sm_state.blendDst = dst;
+	}
+}
+
+void GLState::setBlendEquation(unsigned int mode) {
+	if (sm_state.blendEquation != mode) {
+		glBlendEquation(mode);
+		sm_state.blendEquation = mode;
+	}
+}
+
+void GLState::setDepthTest(bool enabled) {
+	if (sm_state.depthTest != enabled) {
+		setCapability(GL_DEPTH_TEST, enabled);
+		sm_state.depthTest = enabled;
+	}
+}
+
+void GLState::setDepthMask(bool enabled) {
+	if (sm_state.depthMask != enabled) {
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		sm_state.depthMask = enabled;
+	}
+}
+
+void GLState::setDepthFunc(unsigned int func) {
+	if (sm_state.depthFunc != func) {
+		glDepthFunc(func);
+		sm_state.depthFunc = func;
+	}
+}
+
+void GLState::setCullFace(bool enabled) {
+	if (sm_state.cullFace != enabled) {
+		setCapability(GL_CULL_FACE, enabled);
+		sm_state.cullFace = enabled;
+	}
+}
+
+void GLState::setScissorTest(bool enabled) {
+	if (sm_state.scissorTest != enabled) {
+		setCapability(GL_SCISSOR_TEST, enabled);
+		sm_state.scissorTest = enabled;
+	}
+}
+
+void GLState::setViewport(int x, int y, int width, int height) {
+	int* viewport = sm_state.viewport;
+	if (viewport[0] != x || viewport[1] != y || viewport[2] != width || viewport[3] != height) {
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+	}
+}
+
+} // namespace aie
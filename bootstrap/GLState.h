@@ -0,0 +1,74 @@
+#pragma once
+
+namespace aie {
+
+// a shadow copy of the GL state that bootstrap changes while drawing. binding something that is already
+// bound, or setting a state to the value it already has, skips the driver call, and the current state
+// can be read and restored without glGet queries stalling the pipeline. the copy is only correct while
+// these states are changed through this class, so call reset() after any code that changes them directly
+class GLState {
+public:
+
+	enum { TEXTURE_UNITS = 32 };
+
+	// the states that are shadowed, which can be saved before drawing and restored afterwards
+	struct State {
+		unsigned int	program;
+		unsigned int	vertexArray;
+		unsigned int	arrayBuffer;
+		unsigned int	activeTexture;	// the unit, from 0
+		unsigned int	textures[TEXTURE_UNITS];	// GL_TEXTURE_2D on each unit
+		unsigned int	textureArrays[TEXTURE_UNITS];	// GL_TEXTURE_2D_ARRAY on each unit
+
+		bool			blend;
+		unsigned int	blendSrc, blendDst;
+		unsigned int	blendEquation;
+
+		bool			depthTest;
+		bool			depthMask;
+		unsigned int	depthFunc;
+
+		bool			cullFace;
+		bool			scissorTest;
+		int				viewport[4];
+	};
+
+	// reads every shadowed state from the driver. Application calls this once the context is created
+	static void		reset();
+
+	static const State&	get() { return sm_state; }
+
+	// sets every state back to a copy taken from get(), only calling GL for the ones that differ.
+	// texture units are only made active to change their bindings, then the copy's active unit is restored
+	static void		restore(const State& state);
+
+	static void		useProgram(unsigned int program);
+	static void		bindVertexArray(unsigned int vertexArray);
+	static void		bindArrayBuffer(unsigned int buffer);
+	static void		bindTexture(unsigned int texture, unsigned int unit = 0);
+	static void		bindTextureArray(unsigned int texture, unsigned int unit = 0);
+
+	// deleting an object through here forgets any binding of it, as GL unbinds it and may reuse its name
+	static void		deletePrograms(int count, const unsigned int* programs);
+	static void		deleteVertexArrays(int count, const unsigned int* vertexArrays);
+	static void		deleteBuffers(int count, const unsigned int* buffers);
+	static void		deleteTextures(int count, const unsigned int* textures);
+
+	static void		setBlend(bool enabled);
+	static void		setBlendFunc(unsigned int src, unsigned int dst);
+	static void		setBlendEquation(unsigned int mode);
+	static void		setDepthTest(bool enabled);
+	static void		setDepthMask(bool enabled);
+	static void		setDepthFunc(unsigned int func);
+	static void		setCullFace(bool enabled);
+	static void		setScissorTest(bool enabled);
+	static void		setViewport(int x, int y, int width, int height);
+
+private:
+
+	static void		setActiveTexture(unsigned int unit);
+
+	static State	sm_state;
+};
+
+} // namespace aie
@@ -1,29 +1,219 @@
 #include "Gizmos.h"
 #include "gl_core_4_4.h"
+#include "Counters.h"
+#include "StreamBuffer.h"
+#include "GLState.h"
+#include "AssetCache.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <iostream>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+#include <cfloat>
 
 namespace aie {
 
 Gizmos* Gizmos::sm_singleton = nullptr;
 
-Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
-			   unsigned int max2DLines, unsigned int max2DTris)
-	: m_maxLines(maxLines),
+// true only on the thread that created the Gizmos, which writes straight into the stream buffers
+static thread_local bool t_isRenderThread = false;
+
+// a thread's buffer registers itself when the thread first adds a 2D gizmo and unregisters when the thread exits.
+// the mutex is only taken then, and while the buffers are merged or cleared, so adding gizmos never locks
+struct Gizmos::ThreadBuffer {
+	ThreadBuffer() {
+		std::lock_guard<std::mutex> lock(sm_mutex);
+		sm_buffers.push_back(this);
+	}
+
+	~ThreadBuffer() {
+		std::lock_guard<std::mutex> lock(sm_mutex);
+		sm_buffers.erase(std::remove(sm_buffers.begin(), sm_buffers.end(), this), sm_buffers.end());
+	}
+
+	std::vector<Gizmo2DLine>	lines;
+	std::vector<Gizmo2DTri>		tris;
+	std::vector<GizmoCircle>	circles;
+
+	static std::mutex					sm_mutex;
+	static std::vector<ThreadBuffer*>	sm_buffers;
+};
+
+std::mutex Gizmos::ThreadBuffer::sm_mutex;
+std::vector<Gizmos::ThreadBuffer*> Gizmos::ThreadBuffer::sm_buffers;
+
+// a unit mesh, its triangle vertices followed by its line vertices, and this frame's instances of it
+struct Gizmos::GizmoMesh {
+	unsigned int	vbo;
+	unsigned int	vao;
+	unsigned int	triVertexCount;
+	unsigned int	lineVertexCount;
+
+	// a copy of the vertices, for adding instances as triangles and lines
+	std::vector<glm::vec4>		vertices;
+
+	std::vector<GizmoInstance>	opaque;
+	std::vector<GizmoInstance>	transparent;
+
+	// where this frame's instances start in the instance stream buffer, the transparent ones follow the opaque ones
+	unsigned int	opaqueFirst;
+	unsigned int	transparentFirst;
+};
+
+// the transform of an instanced unit mesh, scaled then rotated by the linear part of transform (if any) and moved to center
+static glm::mat4 getInstanceTransform(const glm::vec3& center, const glm::mat4* transform, const glm::vec3& scale) {
+	glm::mat4 instance = transform != nullptr ? *transform : glm::mat4(1);
+	instance[3] = glm::vec4(center, 1);
+	return glm::scale(instance, scale);
+}
+
+// sorting fewer transparent triangles than this isn't worth handing to a worker thread
+static const unsigned int asyncSortThreshold = 4096;
+
+// the sine and cosine (in x and y) of segments + 1 evenly spaced angles around a circle, cached per segment
+// count. the last entry repeats the first so the circle closes exactly. each thread has its own cache as
+// 2D gizmos can be added from any thread
+static const glm::vec2* getUnitCircle(unsigned int segments) {
+	static thread_local std::unordered_map<unsigned int, std::vector<glm::vec2>> cache;
+
+	std::vector<glm::vec2>& table = cache[segments];
+	if (table.empty()) {
+		float segmentSize = (2 * glm::pi<float>()) / segments;
+
+		table.resize(segments + 1);
+		for (unsigned int i = 0; i < segments; ++i)
+			table[i] = glm::vec2(sinf(i * segmentSize), cosf(i * segmentSize));
+		table[segments] = table[0];
+	}
+	return table.data();
+}
+
+// the sine and cosine of segments + 1 evenly spaced angles from start to start + range. full circles come from the
+// cached tables, otherwise only the first angle and the step are evaluated and each following angle is found by
+// rotating the previous one by the step. the result is written to arc, which callers keep to avoid reallocating
+static const glm::vec2* getArc(float start, float range, unsigned int segments, std::vector<glm::vec2>& arc) {
+	if (start == 0 && fabsf(range - 2 * glm::pi<float>()) < 1e-5f)
+		return getUnitCircle(segments);
+
+	glm::vec2 step(sinf(range / segments), cosf(range / segments));
+
+	arc.resize(segments + 1);
+	arc[0] = glm::vec2(sinf(start), cosf(start));
+	for (unsigned int i = 1; i <= segments; ++i)
+		arc[i] = glm::vec2(arc[i - 1].x * step.y + arc[i - 1].y * step.x,
+						   arc[i - 1].y * step.y - arc[i - 1].x * step.x);
+	return arc.data();
+}
+
+// compiles and links a gizmo shader program, binding the vertex attributes to locations 0, 1 and optionally 2
+static unsigned int createProgram(const char* vsSource, const char* fsSource, const char* attribute0, const char* attribute1,
+								  const char* attribute2 = nullptr) {
+
+	// a program linked on an earlier run is loaded from the asset cache instead of compiled
+	unsigned long long key = AssetCache::hash(vsSource);
+	key = AssetCache::hash(fsSource, key);
+	key = AssetCache::hash(attribute0, key);
+	key = AssetCache::hash(attribute1, key);
+	if (attribute2 != nullptr)
+		key = AssetCache::hash(attribute2, key);
+
+	unsigned int program = AssetCache::loadProgram(key);
+	if (program != 0)
+		return program;
+
+	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
+	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(vs, 1, (const char**)&vsSource, 0);
+	glCompileShader(vs);
+
+	glShaderSource(fs, 1, (const char**)&fsSource, 0);
+	glCompileShader(fs);
+
+	program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glBindAttribLocation(program, 0, attribute0);
+	glBindAttribLocation(program, 1, attribute1);
+	if (attribute2 != nullptr)
+		glBindAttribLocation(program, 2, attribute2);
+	AssetCache::prepareProgram(program);
+	glLinkProgram(program);
+    
+	int success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		int infoLogLength = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+		char* infoLog = new char[infoLogLength + 1];
+        
+		glGetProgramInfoLog(program, infoLogLength, 0, infoLog);
+		printf("Error: Failed to link Gizmo shader program!\n%s\n", infoLog);
+		delete[] infoLog;
+	}
+	else
+		AssetCache::storeProgram(key, program);
+
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	return program;
+}
+
+Gizmos::Gizmos(unsigned int lineCapacity, unsigned int triCapacity,
+			   unsigned int line2DCapacity, unsigned int tri2DCapacity,
+			   unsigned int circle2DCapacity)
+	: m_recordingLayer(-1),
+	m_capturing(false),
+	m_tessellationRow(),
+	m_tessellationScale(0),
+	m_tessellationTolerance(0),
+	m_2DtessellationScale(0),
+	m_2DtessellationTolerance(0),
+	m_instanceCapacity(256),
+	m_instanceCount(0),
+	m_instancing(true),
+	m_sortTransparent(false),
+	m_sortTransparentNext(false),
+	m_sortPending(false),
+	m_sortQuit(false),
+	m_sortRow(),
+	m_sortOutput(nullptr),
+	m_maxCapacity(1 << 20),
+	m_shrink(false),
+	m_shrinkFrames(300),
 	m_lineCount(0),
-	m_lines(new GizmoLine[maxLines]),
-	m_maxTris(maxTris),
 	m_triCount(0),
-	m_tris(new GizmoTri[maxTris]),
 	m_transparentTriCount(0),
-	m_transparentTris(new GizmoTri[maxTris]),
-	m_max2DLines(max2DLines),
 	m_2DlineCount(0),
-	m_2Dlines(new GizmoLine[max2DLines]),
-	m_max2DTris(max2DTris),
 	m_2DtriCount(0),
-	m_2Dtris(new GizmoTri[max2DTris]) {
+	m_2DcircleCount(0) {
+
+	unsigned int capacities[BUFFER_TYPE_COUNT] = { lineCapacity, triCapacity, triCapacity, line2DCapacity, tri2DCapacity, circle2DCapacity };
+	size_t primitiveSizes[BUFFER_TYPE_COUNT] = { sizeof(GizmoLine), sizeof(GizmoTri), sizeof(GizmoTri), sizeof(Gizmo2DLine), sizeof(Gizmo2DTri), sizeof(GizmoCircle) };
+
+	// counters for primitives discarded because a buffer couldn't grow
+	const char* droppedCounterNames[BUFFER_TYPE_COUNT] = { "gizmoDroppedLines", "gizmoDroppedTris", "gizmoDroppedTransparentTris",
+														   "gizmoDropped2DLines", "gizmoDropped2DTris", "gizmoDropped2DCircles" };
+
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		GizmoBuffer& buffer = m_buffers[i];
+		buffer.capacity = capacities[i];
+		buffer.startCapacity = capacities[i];
+		buffer.primitiveSize = primitiveSizes[i];
+		buffer.stream = new StreamBuffer(buffer.capacity * buffer.primitiveSize);
+		buffer.lowUsageFrames = 0;
+		buffer.growCapacity = 0;
+		buffer.droppedCounter = Counters::registerCounter(droppedCounterNames[i]);
+		buffer.stats = { buffer.capacity, 0, 0, 0 };
+	}
+
+	updateWritePointers();
+
+	t_isRenderThread = true;
 
 	// create shaders
 	const char* vsSource = "#version 150\n \
@@ -39,138 +229,884 @@ Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
 					 void main()	{ FragColor = vColour; }";
     
     
-	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
-	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
+	m_shader = createProgram(vsSource, fsSource, "Position", "Colour");
+	m_projectionViewUniform = glGetUniformLocation(m_shader, "ProjectionView");
 
-	glShaderSource(vs, 1, (const char**)&vsSource, 0);
-	glCompileShader(vs);
+	// 2D vertices only store x and y, and are always drawn at z = 1
+	const char* vs2DSource = "#version 150\n \
+					 in vec2 Position; \
+					 in vec4 Colour; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 void main() { vColour = Colour; gl_Position = ProjectionView * vec4(Position, 1, 1); }";
 
-	glShaderSource(fs, 1, (const char**)&fsSource, 0);
-	glCompileShader(fs);
+	m_2Dshader = createProgram(vs2DSource, fsSource, "Position", "Colour");
+	m_2DprojectionViewUniform = glGetUniformLocation(m_2Dshader, "ProjectionView");
+
+	// circles are instanced quads, shaded by their signed distance from the circle's edge. the
+	// quad's corners come from gl_VertexID and are padded so the anti-aliased edge isn't clipped
+	const char* circleVsSource = "#version 150\n \
+					 in vec4 Circle; \
+					 in vec4 Colour; \
+					 out vec4 vColour; \
+					 out vec2 vLocal; \
+					 flat out vec2 vRadiusThickness; \
+					 uniform mat4 ProjectionView; \
+					 void main() { \
+						vec2 corner = vec2((gl_VertexID & 1) == 0 ? -1.0 : 1.0, (gl_VertexID & 2) == 0 ? -1.0 : 1.0); \
+						vLocal = corner * Circle.z * 1.05; \
+						vColour = Colour; \
+						vRadiusThickness = Circle.zw; \
+						gl_Position = ProjectionView * vec4(Circle.xy + vLocal, 1, 1); }";
+
+	const char* circleFsSource = "#version 150\n \
+					 in vec4 vColour; \
+					 in vec2 vLocal; \
+					 flat in vec2 vRadiusThickness; \
+					 out vec4 FragColor; \
+					 void main() { \
+						float dist = length(vLocal) - vRadiusThickness.x; \
+						if (vRadiusThickness.y > 0) \
+							dist = abs(dist + vRadiusThickness.y * 0.5) - vRadiusThickness.y * 0.5; \
+						float alpha = clamp(0.5 - dist / fwidth(dist), 0, 1); \
+						if (alpha <= 0) discard; \
+						FragColor = vec4(vColour.rgb, vColour.a * alpha); }";
+
+	m_circleShader = createProgram(circleVsSource, circleFsSource, "Circle", "Colour");
+	m_circleProjectionViewUniform = glGetUniformLocation(m_circleShader, "ProjectionView");
+
+	// instanced meshes store a w of 1 on triangle vertices, which take the instance colour, and 0 on line vertices, which are white
+	const char* instanceVsSource = "#version 150\n \
+					 in vec4 Position; \
+					 in vec4 Colour; \
+					 in mat4 Model; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 void main() { vColour = mix(vec4(1), Colour, Position.w); gl_Position = ProjectionView * Model * vec4(Position.xyz, 1); }";
 
-	m_shader = glCreateProgram();
-	glAttachShader(m_shader, vs);
-	glAttachShader(m_shader, fs);
-	glBindAttribLocation(m_shader, 0, "Position");
-	glBindAttribLocation(m_shader, 1, "Colour");
-	glLinkProgram(m_shader);
+	m_instanceShader = createProgram(instanceVsSource, fsSource, "Position", "Colour", "Model");
+	m_instanceProjectionViewUniform = glGetUniformLocation(m_instanceShader, "ProjectionView");
+	m_instanceStream = new StreamBuffer(m_instanceCapacity * sizeof(GizmoInstance));
     
-	int success = GL_FALSE;
-    glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		int infoLogLength = 0;
-		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-		char* infoLog = new char[infoLogLength + 1];
-        
-		glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
-		printf("Error: Failed to link Gizmo shader program!\n%s\n", infoLog);
-		delete[] infoLog;
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		glGenVertexArrays(1, &m_buffers[i].vao);
+		setVertexLayout((BufferType)i, m_buffers[i].vao, m_buffers[i].stream->getBuffer());
 	}
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
-    
-    // create VBOs
-	glGenBuffers( 1, &m_lineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxLines * sizeof(GizmoLine), m_lines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_triVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_tris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_transparentTriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_transparentTris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DlineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DLines * sizeof(GizmoLine), m_2Dlines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DtriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DTris * sizeof(GizmoTri), m_2Dtris, GL_DYNAMIC_DRAW);
-
-	glGenVertexArrays(1, &m_lineVAO);
-	glBindVertexArray(m_lineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	GLState::bindVertexArray(0);
+	GLState::bindArrayBuffer(0);
+}
 
-	glGenVertexArrays(1, &m_triVAO);
-	glBindVertexArray(m_triVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+Gizmos::~Gizmos() {
+	if (m_sortThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_sortMutex);
+			m_sortQuit = true;
+		}
+		m_sortCondition.notify_all();
+		m_sortThread.join();
+	}
 
-	glGenVertexArrays(1, &m_transparentTriVAO);
-	glBindVertexArray(m_transparentTriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	for (auto& mesh : m_meshes) {
+		GLState::deleteBuffers(1, &mesh.second->vbo);
+		GLState::deleteVertexArrays(1, &mesh.second->vao);
+		delete mesh.second;
+	}
+	delete m_instanceStream;
+	GLState::deletePrograms(1, &m_instanceShader);
+	for (auto& layer : m_layers) {
+		GLState::deleteBuffers(BUFFER_TYPE_COUNT, layer.buffers);
+		GLState::deleteVertexArrays(BUFFER_TYPE_COUNT, layer.vaos);
+	}
+	for (auto& buffer : m_buffers) {
+		delete buffer.stream;
+		GLState::deleteVertexArrays(1, &buffer.vao);
+	}
+	GLState::deletePrograms(1, &m_circleShader);
+	GLState::deletePrograms(1, &m_2Dshader);
+	GLState::deletePrograms(1, &m_shader);
+}
 
-	glGenVertexArrays(1, &m_2DlineVAO);
-	glBindVertexArray(m_2DlineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
+void Gizmos::setVertexLayout(BufferType type, unsigned int vao, unsigned int buffer) {
+	GLState::bindVertexArray(vao);
+	GLState::bindArrayBuffer(buffer);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
-	glGenVertexArrays(1, &m_2DtriVAO);
-	glBindVertexArray(m_2DtriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
+	switch (type) {
+	case BUFFER_LINES:
+	case BUFFER_TRIS:
+	case BUFFER_TRANSPARENT_TRIS:
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+		break;
+	case BUFFER_2D_LINES:
+	case BUFFER_2D_TRIS:
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Gizmo2DVertex), 0);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Gizmo2DVertex), (void*)8);
+		break;
+	case BUFFER_2D_CIRCLES:
+		// the circle attributes are per-instance. a stream buffer's pointers are set again when drawn as the section offset changes each frame
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoCircle), 0);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GizmoCircle), (void*)16);
+		glVertexAttribDivisor(0, 1);
+		glVertexAttribDivisor(1, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+unsigned int& Gizmos::getCount(BufferType type) {
+	switch (type) {
+	case BUFFER_LINES:				return m_lineCount;
+	case BUFFER_TRIS:				return m_triCount;
+	case BUFFER_TRANSPARENT_TRIS:	return m_transparentTriCount;
+	case BUFFER_2D_LINES:			return m_2DlineCount;
+	case BUFFER_2D_TRIS:			return m_2DtriCount;
+	default:						return m_2DcircleCount;
+	}
+}
+
+void Gizmos::updateWritePointers() {
+	m_lines = (GizmoLine*)getWriteData(BUFFER_LINES);
+	m_tris = (GizmoTri*)getWriteData(BUFFER_TRIS);
+	m_transparentTris = (GizmoTri*)getWriteData(BUFFER_TRANSPARENT_TRIS);
+	m_2Dlines = (Gizmo2DLine*)getWriteData(BUFFER_2D_LINES);
+	m_2Dtris = (Gizmo2DTri*)getWriteData(BUFFER_2D_TRIS);
+	m_2Dcircles = (GizmoCircle*)getWriteData(BUFFER_2D_CIRCLES);
+}
+
+char* Gizmos::getWriteData(BufferType type) {
+	if (m_capturing)
+		return m_captured[type].data();
+	if (type == BUFFER_TRANSPARENT_TRIS && m_sortTransparent)
+		return (char*)m_transparentStaging.data();
+	return (char*)m_buffers[type].stream->getWritePointer();
+}
+
+void Gizmos::beginCapture() {
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		unsigned int& count = getCount((BufferType)i);
+		m_frameCounts[i] = count;
+		count = 0;
+		m_captured[i].clear();
+	}
+
+	m_capturing = true;
+	updateWritePointers();
+}
+
+void Gizmos::endCapture(unsigned int* counts) {
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		unsigned int& count = getCount((BufferType)i);
+		counts[i] = count;
+		count = m_frameCounts[i];
+	}
+
+	m_capturing = false;
+	updateWritePointers();
+}
+
+void Gizmos::resize(BufferType type, unsigned int capacity) {
+	GizmoBuffer& buffer = m_buffers[type];
+
+	// GL keeps the old buffer's storage alive until the GPU has finished drawing from it
+	StreamBuffer* stream = new StreamBuffer(capacity * buffer.primitiveSize);
+	if (type == BUFFER_TRANSPARENT_TRIS && m_sortTransparent)
+		m_transparentStaging.resize(capacity);
+	delete buffer.stream;
+
+	buffer.stream = stream;
+	buffer.capacity = capacity;
+	buffer.lowUsageFrames = 0;
+	buffer.growCapacity = 0;
+	buffer.stats.capacity = capacity;
+	buffer.stats.resizeCount++;
+
+	setVertexLayout(type, buffer.vao, buffer.stream->getBuffer());
+	GLState::bindVertexArray(0);
+	GLState::bindArrayBuffer(0);
+
+	updateWritePointers();
+}
+
+unsigned int Gizmos::reserve(BufferType type, unsigned int used, unsigned int count) {
+	GizmoBuffer& buffer = m_buffers[type];
+
+	// captured primitives are only limited by memory
+	if (m_capturing) {
+		std::vector<char>& captured = m_captured[type];
+		size_t required = ((size_t)used + count) * buffer.primitiveSize;
+		if (captured.size() < required) {
+			captured.resize(glm::max(required, captured.size() * 2));
+			updateWritePointers();
+		}
+		return count;
+	}
+
+	if (count <= buffer.capacity - used)
+		return count;
+
+	// double the capacity until everything fits, or it reaches the maximum
+	if (buffer.capacity < m_maxCapacity) {
+		unsigned long long required = (unsigned long long)used + count;
+		unsigned long long capacity = glm::max(buffer.capacity, 64u);
+		while (capacity < required && capacity < m_maxCapacity)
+			capacity *= 2;
+		capacity = glm::min(capacity, (unsigned long long)m_maxCapacity);
+
+		// staged primitives are written to the stream buffer when they're drawn, so it can be replaced now
+		if (type == BUFFER_TRANSPARENT_TRIS && m_sortTransparent)
+			resize(type, (unsigned int)capacity);
+		else
+			buffer.growCapacity = glm::max(buffer.growCapacity, (unsigned int)capacity);
+	}
+
+	unsigned int fits = glm::min(count, buffer.capacity - used);
+	if (fits < count) {
+		buffer.stats.overflowCount += count - fits;
+		Counters::increment(buffer.droppedCounter, count - fits);
+	}
+	return fits;
+}
+
+unsigned int Gizmos::packColour(const glm::vec4& colour) {
+	glm::uvec4 c = glm::uvec4(glm::clamp(colour, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return c.r | (c.g << 8) | (c.b << 16) | (c.a << 24);
+}
+
+void Gizmos::create(unsigned int lineCapacity, unsigned int triCapacity,
+					unsigned int line2DCapacity, unsigned int tri2DCapacity,
+					unsigned int circle2DCapacity) {
+	if (sm_singleton == nullptr)
+		sm_singleton = new Gizmos(lineCapacity,triCapacity,line2DCapacity,tri2DCapacity,circle2DCapacity);
+}
+
+Gizmos::ThreadBuffer* Gizmos::getThreadBuffer() {
+	static thread_local ThreadBuffer buffer;
+	return &buffer;
+}
+
+void Gizmos::mergeThreadBuffers() {
+	std::lock_guard<std::mutex> lock(ThreadBuffer::sm_mutex);
+
+	for (auto buffer : ThreadBuffer::sm_buffers) {
+		unsigned int count = (unsigned int)buffer->lines.size();
+		if (count > 0) {
+			memcpy(allocate2DLines(count), buffer->lines.data(), count * sizeof(Gizmo2DLine));
+			buffer->lines.clear();
+		}
+
+		count = (unsigned int)buffer->tris.size();
+		if (count > 0) {
+			memcpy(allocate2DTris(count), buffer->tris.data(), count * sizeof(Gizmo2DTri));
+			buffer->tris.clear();
+		}
+
+		count = (unsigned int)buffer->circles.size();
+		if (count > 0) {
+			memcpy(allocate2DCircles(count), buffer->circles.data(), count * sizeof(GizmoCircle));
+			buffer->circles.clear();
+		}
+	}
+}
+
+void Gizmos::clearThreadBuffers() {
+	std::lock_guard<std::mutex> lock(ThreadBuffer::sm_mutex);
+
+	for (auto buffer : ThreadBuffer::sm_buffers) {
+		buffer->lines.clear();
+		buffer->tris.clear();
+		buffer->circles.clear();
+	}
+}
+
+Gizmos::Gizmo2DLine* Gizmos::allocate2DLines(unsigned int& count) {
+	if (t_isRenderThread == false) {
+		std::vector<Gizmo2DLine>& lines = getThreadBuffer()->lines;
+		lines.resize(lines.size() + count);
+		return lines.data() + lines.size() - count;
+	}
+
+	count = reserve(BUFFER_2D_LINES, m_2DlineCount, count);
+	Gizmo2DLine* lines = m_2Dlines + m_2DlineCount;
+	m_2DlineCount += count;
+	return lines;
+}
+
+Gizmos::Gizmo2DTri* Gizmos::allocate2DTris(unsigned int& count) {
+	if (t_isRenderThread == false) {
+		std::vector<Gizmo2DTri>& tris = getThreadBuffer()->tris;
+		tris.resize(tris.size() + count);
+		return tris.data() + tris.size() - count;
+	}
+
+	count = reserve(BUFFER_2D_TRIS, m_2DtriCount, count);
+	Gizmo2DTri* tris = m_2Dtris + m_2DtriCount;
+	m_2DtriCount += count;
+	return tris;
+}
+
+Gizmos::GizmoCircle* Gizmos::allocate2DCircles(unsigned int& count) {
+	if (t_isRenderThread == false) {
+		std::vector<GizmoCircle>& circles = getThreadBuffer()->circles;
+		circles.resize(circles.size() + count);
+		return circles.data() + circles.size() - count;
+	}
+
+	count = reserve(BUFFER_2D_CIRCLES, m_2DcircleCount, count);
+	GizmoCircle* circles = m_2Dcircles + m_2DcircleCount;
+	m_2DcircleCount += count;
+	return circles;
+}
+
+bool Gizmos::hasLayer(const char* name) {
+	if (sm_singleton == nullptr)
+		return false;
+
+	for (auto& layer : sm_singleton->m_layers)
+		if (layer.name == name)
+			return true;
+	return false;
+}
+
+void Gizmos::beginLayer(const char* name) {
+	if (sm_singleton == nullptr)
+		return;
+
+	endLayer();
+	invalidateLayer(name);
+
+	GizmoLayer layer = {};
+	layer.name = name;
+	sm_singleton->m_layers.push_back(layer);
+
+	sm_singleton->m_recordingLayer = (int)sm_singleton->m_layers.size() - 1;
+	sm_singleton->beginCapture();
+}
+
+void Gizmos::endLayer() {
+	if (sm_singleton == nullptr ||
+		sm_singleton->m_recordingLayer < 0)
+		return;
+
+	GizmoLayer& layer = sm_singleton->m_layers[sm_singleton->m_recordingLayer];
+	sm_singleton->m_recordingLayer = -1;
+	sm_singleton->endCapture(layer.counts);
+
+	// the layer's gizmos were captured in CPU memory, so upload them into static buffers
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		BufferType type = (BufferType)i;
+		if (layer.counts[i] == 0)
+			continue;
+
+		glGenBuffers(1, &layer.buffers[i]);
+		GLState::bindArrayBuffer(layer.buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, layer.counts[i] * sm_singleton->m_buffers[i].primitiveSize,
+					 sm_singleton->m_captured[i].data(), GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &layer.vaos[i]);
+		sm_singleton->setVertexLayout(type, layer.vaos[i], layer.buffers[i]);
+	}
+
+	GLState::bindVertexArray(0);
+	GLState::bindArrayBuffer(0);
+}
+
+void Gizmos::invalidateLayer(const char* name) {
+	if (sm_singleton == nullptr)
+		return;
+
+	auto& layers = sm_singleton->m_layers;
+	for (unsigned int i = 0; i < layers.size(); ++i) {
+		if (layers[i].name == name && (int)i != sm_singleton->m_recordingLayer) {
+			GLState::deleteBuffers(BUFFER_TYPE_COUNT, layers[i].buffers);
+			GLState::deleteVertexArrays(BUFFER_TYPE_COUNT, layers[i].vaos);
+			layers.erase(layers.begin() + i);
+
+			if (sm_singleton->m_recordingLayer > (int)i)
+				sm_singleton->m_recordingLayer--;
+			return;
+		}
+	}
+}
+
+unsigned int Gizmos::getLayerCount(BufferType type) const {
+	unsigned int count = 0;
+	for (auto& layer : m_layers)
+		count += layer.counts[type];
+	return count;
+}
+
+void Gizmos::drawLayers(BufferType type) {
+	for (auto& layer : m_layers) {
+		if (layer.counts[type] == 0)
+			continue;
+
+		GLState::bindVertexArray(layer.vaos[type]);
+		switch (type) {
+		case BUFFER_LINES:
+		case BUFFER_2D_LINES:
+			glDrawArrays(GL_LINES, 0, layer.counts[type] * 2);
+			break;
+		case BUFFER_2D_CIRCLES:
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layer.counts[type]);
+			break;
+		default:
+			glDrawArrays(GL_TRIANGLES, 0, layer.counts[type] * 3);
+			break;
+		}
+	}
+}
+
+void Gizmos::setGrowth(unsigned int maxCapacity, bool shrink, unsigned int shrinkFrames) {
+	if (sm_singleton == nullptr)
+		return;
+	sm_singleton->m_maxCapacity = maxCapacity;
+	sm_singleton->m_shrink = shrink;
+	sm_singleton->m_shrinkFrames = shrinkFrames;
+}
+
+void Gizmos::setTessellation(const glm::mat4& projection, const glm::mat4& view, float viewportHeight, float tolerance) {
+	if (sm_singleton == nullptr)
+		return;
+
+	glm::mat4 projectionView = projection * view;
+	for (int i = 0; i < 4; ++i)
+		sm_singleton->m_tessellationRow[i] = projectionView[i][3];
+
+	sm_singleton->m_tessellationScale = fabsf(projection[1][1]) * viewportHeight * 0.5f;
+	sm_singleton->m_tessellationTolerance = tolerance;
+}
+
+void Gizmos::set2DTessellation(const glm::mat4& projection, float viewportHeight, float tolerance) {
+	if (sm_singleton == nullptr)
+		return;
+	sm_singleton->m_2DtessellationScale = fabsf(projection[1][1]) * viewportHeight * 0.5f;
+	sm_singleton->m_2DtessellationTolerance = tolerance;
+}
+
+float Gizmos::getPixelRadius(const glm::vec3& center, float radius) {
+	if (sm_singleton == nullptr ||
+		sm_singleton->m_tessellationTolerance <= 0)
+		return -1;
+
+	const float* row = sm_singleton->m_tessellationRow;
+	float w = row[0] * center.x + row[1] * center.y + row[2] * center.z + row[3];
+
+	// anything behind the camera can't be seen, so it gets the fewest segments
+	if (w <= 0)
+		return 0;
+	return fabsf(radius) * sm_singleton->m_tessellationScale / w;
+}
+
+float Gizmos::get2DPixelRadius(float radius) {
+	if (sm_singleton == nullptr ||
+		sm_singleton->m_2DtessellationTolerance <= 0)
+		return -1;
+	return fabsf(radius) * sm_singleton->m_2DtessellationScale;
+}
+
+unsigned int Gizmos::adaptSegments(unsigned int segments, float angle, float pixelRadius, float tolerance) {
+	if (pixelRadius < 0)
+		return segments;
+
+	// a chord spanning theta radians strays r * (1 - cos(theta / 2)) from the curve
+	unsigned int minSegments = fabsf(angle) >= 2 * glm::pi<float>() - 1e-5f ? 3 : 1;
+	if (pixelRadius <= tolerance)
+		return glm::min(segments, minSegments);
+
+	float maxAngle = 2 * acosf(1 - tolerance / pixelRadius);
+	unsigned int needed = (unsigned int)ceilf(fabsf(angle) / maxAngle);
+	return glm::min(segments, glm::max(needed, minSegments));
+}
+
+void Gizmos::setInstancing(bool enabled) {
+	if (sm_singleton == nullptr)
+		return;
+	sm_singleton->m_instancing = enabled;
+}
+
+bool Gizmos::canInstance() const {
+	return m_instancing && m_capturing == false && t_isRenderThread;
+}
+
+Gizmos::GizmoMesh* Gizmos::getMesh(MeshType type, unsigned int resolution0, unsigned int resolution1) {
+	unsigned long long key = ((unsigned long long)type << 48) | ((unsigned long long)resolution0 << 24) | resolution1;
+	auto iter = m_meshes.find(key);
+	if (iter != m_meshes.end())
+		return iter->second;
+
+	// the mesh is built by the functions that add each shape as triangles and lines, at the origin with a size
+	// of 1 and without adapting the resolution, and captured in CPU memory so that it's never cut short
+	float tolerance = m_tessellationTolerance;
+	m_tessellationTolerance = 0;
+	beginCapture();
+
+	glm::vec3 origin(0);
+	glm::vec4 white(1);
+
+	switch (type) {
+	case MESH_SPHERE:
+		addSphere(origin, 1, resolution0, resolution1, white);
+		break;
+	case MESH_HEMISPHERE_TOP:
+		addSphere(origin, 1, resolution0, resolution1, white, nullptr, 0, 360, 0, 90);
+		break;
+	case MESH_HEMISPHERE_BOTTOM:
+		addSphere(origin, 1, resolution0, resolution1, white, nullptr, 0, 360, -90, 0);
+		break;
+	case MESH_CYLINDER:
+		addCylinderFilled(origin, 1, 1, resolution0, white);
+		break;
+	case MESH_TUBE: {
+		// the open band between a capsule's hemispheres, from y = -1 to 1
+		const glm::vec2* circle = getUnitCircle(resolution0);
+		glm::vec3 top(0, 1, 0);
+
+		for (unsigned int i = 0; i < resolution0; ++i) {
+			glm::vec3 pos(circle[i].y, 0, circle[i].x);
+			glm::vec3 pos1(circle[i + 1].y, 0, circle[i + 1].x);
+
+			addTri(top + pos1, pos1 - top, pos - top, white);
+			addTri(top + pos1, pos - top, top + pos, white);
+
+			addLine(top + pos, top + pos1, white, white);
+			addLine(pos - top, pos1 - top, white, white);
+			addLine(top + pos, pos - top, white, white);
+		}
+		break;
+	}
+	case MESH_BOX:
+		addAABBFilled(origin, glm::vec3(1), white);
+		break;
+	default:
+		break;
+	}
+
+	unsigned int counts[BUFFER_TYPE_COUNT];
+	endCapture(counts);
+	m_tessellationTolerance = tolerance;
+
+	const GizmoTri* tris = (const GizmoTri*)m_captured[BUFFER_TRIS].data();
+	const GizmoLine* lines = (const GizmoLine*)m_captured[BUFFER_LINES].data();
+
+	// triangle vertices have a w of 1 so that they take the instance colour, line vertices have a w of 0 so they stay white
+	std::vector<glm::vec4> vertices;
+	vertices.reserve(counts[BUFFER_TRIS] * 3 + counts[BUFFER_LINES] * 2);
+	for (unsigned int i = 0; i < counts[BUFFER_TRIS]; ++i) {
+		vertices.push_back(glm::vec4(tris[i].v0.x, tris[i].v0.y, tris[i].v0.z, 1));
+		vertices.push_back(glm::vec4(tris[i].v1.x, tris[i].v1.y, tris[i].v1.z, 1));
+		vertices.push_back(glm::vec4(tris[i].v2.x, tris[i].v2.y, tris[i].v2.z, 1));
+	}
+	for (unsigned int i = 0; i < counts[BUFFER_LINES]; ++i) {
+		vertices.push_back(glm::vec4(lines[i].v0.x, lines[i].v0.y, lines[i].v0.z, 0));
+		vertices.push_back(glm::vec4(lines[i].v1.x, lines[i].v1.y, lines[i].v1.z, 0));
+	}
+
+	GizmoMesh* mesh = new GizmoMesh();
+	mesh->triVertexCount = counts[BUFFER_TRIS] * 3;
+	mesh->lineVertexCount = counts[BUFFER_LINES] * 2;
+	mesh->opaqueFirst = 0;
+	mesh->transparentFirst = 0;
+
+	glGenBuffers(1, &mesh->vbo);
+	GLState::bindArrayBuffer(mesh->vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec4), vertices.data(), GL_STATIC_DRAW);
+	mesh->vertices = std::move(vertices);
+
+	glGenVertexArrays(1, &mesh->vao);
+	GLState::bindVertexArray(mesh->vao);
 	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+
+	// the colour and the 4 columns of the transform are per-instance. they're pointed at the instance stream buffer
+	// when drawn, as the section offset changes each frame
+	for (unsigned int i = 1; i <= 5; ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::bindVertexArray(0);
+	GLState::bindArrayBuffer(0);
+
+	m_meshes[key] = mesh;
+	return mesh;
 }
 
-Gizmos::~Gizmos() {
-	delete[] m_lines;
-	delete[] m_tris;
-	delete[] m_transparentTris;
-	glDeleteBuffers( 1, &m_lineVBO );
-	glDeleteBuffers( 1, &m_triVBO );
-	glDeleteBuffers( 1, &m_transparentTriVBO );
-	glDeleteVertexArrays( 1, &m_lineVAO );
-	glDeleteVertexArrays( 1, &m_triVAO );
-	glDeleteVertexArrays( 1, &m_transparentTriVAO );
-	delete[] m_2Dlines;
-	delete[] m_2Dtris;
-	glDeleteBuffers( 1, &m_2DlineVBO );
-	glDeleteBuffers( 1, &m_2DtriVBO );
-	glDeleteVertexArrays( 1, &m_2DlineVAO );
-	glDeleteVertexArrays( 1, &m_2DtriVAO );
-	glDeleteProgram(m_shader);
-}
-
-void Gizmos::create(unsigned int maxLines, unsigned int maxTris,
-					unsigned int max2DLines, unsigned int max2DTris) {
+void Gizmos::addInstance(MeshType type, unsigned int resolution0, unsigned int resolution1,
+						 const glm::mat4& transform, const glm::vec4& colour) {
+	GizmoMesh* mesh = getMesh(type, resolution0, resolution1);
+
+	// sorted transparent triangles all have to be in the transparent buffer, so the mesh is added as triangles and lines
+	if (colour.w != 1 && m_sortTransparent) {
+		const glm::vec4* vertices = mesh->vertices.data();
+		glm::vec4 white(1);
+
+		for (unsigned int i = 0; i < mesh->triVertexCount; i += 3)
+			addTri(glm::vec3(transform * glm::vec4(glm::vec3(vertices[i]), 1)),
+				   glm::vec3(transform * glm::vec4(glm::vec3(vertices[i + 1]), 1)),
+				   glm::vec3(transform * glm::vec4(glm::vec3(vertices[i + 2]), 1)), colour);
+
+		for (unsigned int i = mesh->triVertexCount; i < mesh->triVertexCount + mesh->lineVertexCount; i += 2)
+			addLine(glm::vec3(transform * glm::vec4(glm::vec3(vertices[i]), 1)),
+					glm::vec3(transform * glm::vec4(glm::vec3(vertices[i + 1]), 1)), white, white);
+		return;
+	}
+
+	GizmoInstance instance;
+	memcpy(instance.transform, glm::value_ptr(transform), sizeof(instance.transform));
+	instance.colour = packColour(colour);
+
+	if (colour.w == 1)
+		mesh->opaque.push_back(instance);
+	else
+		mesh->transparent.push_back(instance);
+	m_instanceCount++;
+}
+
+void Gizmos::uploadInstances() {
+
+	// grow the stream buffer until every instance fits. GL keeps the old buffer's storage alive until the GPU has finished with it
+	if (m_instanceCount > m_instanceCapacity) {
+		while (m_instanceCapacity < m_instanceCount)
+			m_instanceCapacity *= 2;
+
+		delete m_instanceStream;
+		m_instanceStream = new StreamBuffer(m_instanceCapacity * sizeof(GizmoInstance));
+	}
+
+	GizmoInstance* instances = (GizmoInstance*)m_instanceStream->getWritePointer();
+	unsigned int count = 0;
+
+	for (auto& entry : m_meshes) {
+		GizmoMesh* mesh = entry.second;
+
+		mesh->opaqueFirst = count;
+		if (mesh->opaque.empty() == false)
+			memcpy(instances + count, mesh->opaque.data(), mesh->opaque.size() * sizeof(GizmoInstance));
+		count += (unsigned int)mesh->opaque.size();
+
+		mesh->transparentFirst = count;
+		if (mesh->transparent.empty() == false)
+			memcpy(instances + count, mesh->transparent.data(), mesh->transparent.size() * sizeof(GizmoInstance));
+		count += (unsigned int)mesh->transparent.size();
+	}
+
+	m_instanceStream->flush(count * sizeof(GizmoInstance));
+}
+
+void Gizmos::drawInstances(const glm::mat4& projectionView, bool transparent) {
+	GLState::useProgram(m_instanceShader);
+	glUniformMatrix4fv(m_instanceProjectionViewUniform, 1, false, glm::value_ptr(projectionView));
+	GLState::bindArrayBuffer(m_instanceStream->getBuffer());
+
+	for (auto& entry : m_meshes) {
+		GizmoMesh* mesh = entry.second;
+		unsigned int opaqueCount = (unsigned int)mesh->opaque.size();
+		unsigned int transparentCount = (unsigned int)mesh->transparent.size();
+
+		// the opaque pass also draws the transparent instances' lines, which follow straight on from the opaque instances
+		unsigned int first = transparent ? mesh->transparentFirst : mesh->opaqueFirst;
+		unsigned int count = transparent ? transparentCount : opaqueCount + transparentCount;
+		if (count == 0)
+			continue;
+
+		size_t offset = m_instanceStream->getDrawOffset() + first * sizeof(GizmoInstance);
+
+		GLState::bindVertexArray(mesh->vao);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GizmoInstance), (void*)(offset + sizeof(float) * 16));
+		for (unsigned int column = 0; column < 4; ++column)
+			glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoInstance), (void*)(offset + sizeof(float) * 4 * column));
+
+		if (transparent) {
+			glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->triVertexCount, transparentCount);
+		}
+		else {
+			if (opaqueCount > 0)
+				glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->triVertexCount, opaqueCount);
+			glDrawArraysInstanced(GL_LINES, mesh->triVertexCount, mesh->lineVertexCount, count);
+		}
+	}
+}
+
+void Gizmos::setTransparentSorting(bool enabled) {
 	if (sm_singleton == nullptr)
-		sm_singleton = new Gizmos(maxLines,maxTris,max2DLines,max2DTris);
+		return;
+
+	sm_singleton->m_sortTransparentNext = enabled;
+	sm_singleton->updateTransparentSorting();
+}
+
+void Gizmos::updateTransparentSorting() {
+
+	// triangles already added this frame would have to move, but they can't be read back out of the stream
+	// buffer's write-only mapping, so the change waits until clear()
+	unsigned int frameCount = m_capturing ? m_frameCounts[BUFFER_TRANSPARENT_TRIS] : m_transparentTriCount;
+	if (m_sortTransparent == m_sortTransparentNext ||
+		frameCount > 0)
+		return;
+
+	if (m_sortTransparentNext)
+		m_transparentStaging.resize(m_buffers[BUFFER_TRANSPARENT_TRIS].capacity);
+	else
+		std::vector<GizmoTri>().swap(m_transparentStaging);
+
+	m_sortTransparent = m_sortTransparentNext;
+	updateWritePointers();
+}
+
+void Gizmos::startSort(const glm::vec4& depthRow, GizmoTri* sorted) {
+	std::lock_guard<std::mutex> lock(m_sortMutex);
+
+	if (m_sortThread.joinable() == false)
+		m_sortThread = std::thread(&Gizmos::sortWork, this);
+
+	memcpy(m_sortRow, glm::value_ptr(depthRow), sizeof(m_sortRow));
+	m_sortOutput = sorted;
+	m_sortPending = true;
+	m_sortCondition.notify_all();
+}
+
+void Gizmos::finishSort() {
+	std::unique_lock<std::mutex> lock(m_sortMutex);
+	m_sortCondition.wait(lock, [this]() { return m_sortPending == false; });
+}
+
+void Gizmos::sortWork() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_sortMutex);
+			m_sortCondition.wait(lock, [this]() { return m_sortQuit || m_sortPending; });
+			if (m_sortQuit)
+				return;
+		}
+
+		sortTransparentTris(glm::make_vec4(m_sortRow), m_sortOutput);
+
+		{
+			std::lock_guard<std::mutex> lock(m_sortMutex);
+			m_sortPending = false;
+		}
+		m_sortCondition.notify_all();
+	}
+}
+
+void Gizmos::sortTransparentTris(const glm::vec4& depthRow, GizmoTri* sorted) {
+	unsigned int count = m_transparentTriCount;
+	const GizmoTri* tris = m_transparentStaging.data();
+
+	m_sortDepths.resize(count);
+	m_sortItems.resize(count);
+	m_sortScratch.resize(count);
+
+	// the depth of each triangle's centre, times 3 and without the projection-view's translation as only the order matters
+	float minDepth = FLT_MAX;
+	float maxDepth = -FLT_MAX;
+	for (unsigned int i = 0; i < count; ++i) {
+		const GizmoTri& tri = tris[i];
+		float depth = depthRow.x * (tri.v0.x + tri.v1.x + tri.v2.x) +
+					  depthRow.y * (tri.v0.y + tri.v1.y + tri.v2.y) +
+					  depthRow.z * (tri.v0.z + tri.v1.z + tri.v2.z);
+		m_sortDepths[i] = depth;
+		minDepth = glm::min(minDepth, depth);
+		maxDepth = glm::max(maxDepth, depth);
+	}
+
+	// each item is a 16-bit key, quantised so that the farthest triangle is 0, above the triangle's index
+	float scale = maxDepth > minDepth ? 65535.0f / (maxDepth - minDepth) : 0.0f;
+	for (unsigned int i = 0; i < count; ++i)
+		m_sortItems[i] = ((unsigned long long)((maxDepth - m_sortDepths[i]) * scale) << 32) | i;
+
+	// an 8-bit radix sort in two passes, which is stable so triangles at the same depth keep the order they were added in
+	for (unsigned int shift = 32; shift < 48; shift += 8) {
+		unsigned int offsets[256] = {};
+		for (unsigned int i = 0; i < count; ++i)
+			offsets[(m_sortItems[i] >> shift) & 0xff]++;
+
+		unsigned int total = 0;
+		for (unsigned int& offset : offsets) {
+			unsigned int bucket = offset;
+			offset = total;
+			total += bucket;
+		}
+
+		for (unsigned int i = 0; i < count; ++i)
+			m_sortScratch[offsets[(m_sortItems[i] >> shift) & 0xff]++] = m_sortItems[i];
+		m_sortItems.swap(m_sortScratch);
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+		sorted[i] = tris[(unsigned int)m_sortItems[i]];
+}
+
+const Gizmos::BufferStats& Gizmos::getBufferStats(BufferType type) {
+	static const BufferStats empty = {};
+	if (sm_singleton == nullptr)
+		return empty;
+	return sm_singleton->m_buffers[type].stats;
 }
 
 void Gizmos::destroy() {
+	t_isRenderThread = false;
 	delete sm_singleton;
 	sm_singleton = nullptr;
 }
 
 void Gizmos::clear() {
-	sm_singleton->m_lineCount = 0;
-	sm_singleton->m_triCount = 0;
-	sm_singleton->m_transparentTriCount = 0;
-	sm_singleton->m_2DlineCount = 0;
-	sm_singleton->m_2DtriCount = 0;
+
+	unsigned int counts[BUFFER_TYPE_COUNT] = { sm_singleton->m_lineCount, sm_singleton->m_triCount, sm_singleton->m_transparentTriCount,
+											   sm_singleton->m_2DlineCount, sm_singleton->m_2DtriCount, sm_singleton->m_2DcircleCount };
+
+	// a capture carries on into the next frame, only the frame's own counts are reset
+	if (sm_singleton->m_capturing)
+		memcpy(counts, sm_singleton->m_frameCounts, sizeof(counts));
+
+	for (unsigned int i = 0; i < BUFFER_TYPE_COUNT; ++i) {
+		GizmoBuffer& buffer = sm_singleton->m_buffers[i];
+		buffer.stats.highWaterMark = glm::max(buffer.stats.highWaterMark, counts[i]);
+
+		// move the buffer on to the section for this frame, which the GPU has finished drawing from
+		buffer.stream->nextFrame();
+
+		// grow a buffer that filled up last frame, or halve one that has stayed mostly empty.
+		// it's replaced before anything is written this frame
+		if (buffer.growCapacity > buffer.capacity) {
+			sm_singleton->resize((BufferType)i, buffer.growCapacity);
+		}
+		else if (sm_singleton->m_shrink && buffer.capacity > buffer.startCapacity && counts[i] < buffer.capacity / 4) {
+			if (++buffer.lowUsageFrames >= sm_singleton->m_shrinkFrames)
+				sm_singleton->resize((BufferType)i, glm::max(buffer.capacity / 2, buffer.startCapacity));
+		}
+		else {
+			buffer.lowUsageFrames = 0;
+		}
+	}
+
+	sm_singleton->updateWritePointers();
+	sm_singleton->clearThreadBuffers();
+
+	sm_singleton->m_instanceStream->nextFrame();
+	for (auto& mesh : sm_singleton->m_meshes) {
+		mesh.second->opaque.clear();
+		mesh.second->transparent.clear();
+	}
+	sm_singleton->m_instanceCount = 0;
+
+	if (sm_singleton->m_capturing) {
+		memset(sm_singleton->m_frameCounts, 0, sizeof(sm_singleton->m_frameCounts));
+	}
+	else {
+		sm_singleton->m_lineCount = 0;
+		sm_singleton->m_triCount = 0;
+		sm_singleton->m_transparentTriCount = 0;
+		sm_singleton->m_2DlineCount = 0;
+		sm_singleton->m_2DtriCount = 0;
+		sm_singleton->m_2DcircleCount = 0;
+	}
+
+	sm_singleton->updateTransparentSorting();
 }
 
 // Adds 3 unit-length lines (red,green,blue) representing the 3 axis of a transform, 
@@ -254,6 +1190,11 @@ void Gizmos::addAABBFilled(const glm::vec3& center,
 		tempCenter = glm::vec3((*transform)[3]) + tempCenter;
 	}
 
+	if (sm_singleton != nullptr && sm_singleton->canInstance()) {
+		sm_singleton->addInstance(MESH_BOX, 0, 0, getInstanceTransform(tempCenter, transform, rvExtents), fillColour);
+		return;
+	}
+
 	// top verts
 	vVerts[0] = tempCenter - vX - vZ - vY;
 	vVerts[1] = tempCenter - vX + vZ - vY;
@@ -315,15 +1256,23 @@ void Gizmos::addCylinderFilled(const glm::vec3& center, float radius, float fHal
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
 
-	float segmentSize = (2 * glm::pi<float>()) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * glm::pi<float>(), getPixelRadius(tempCenter, radius), sm_singleton->m_tessellationTolerance);
+
+	if (sm_singleton != nullptr && sm_singleton->canInstance()) {
+		sm_singleton->addInstance(MESH_CYLINDER, segments, 0, getInstanceTransform(tempCenter, transform, glm::vec3(radius, fHalfLength, radius)), fillColour);
+		return;
+	}
+
+	const glm::vec2* circle = getUnitCircle(segments);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
 		glm::vec3 v0top(0,fHalfLength,0);
-		glm::vec3 v1top( sinf( i * segmentSize ) * radius, fHalfLength, cosf( i * segmentSize ) * radius);
-		glm::vec3 v2top( sinf( (i+1) * segmentSize ) * radius, fHalfLength, cosf( (i+1) * segmentSize ) * radius);
+		glm::vec3 v1top( circle[i].x * radius, fHalfLength, circle[i].y * radius);
+		glm::vec3 v2top( circle[i+1].x * radius, fHalfLength, circle[i+1].y * radius);
 		glm::vec3 v0bottom(0,-fHalfLength,0);
-		glm::vec3 v1bottom( sinf( i * segmentSize ) * radius, -fHalfLength, cosf( i * segmentSize ) * radius);
-		glm::vec3 v2bottom( sinf( (i+1) * segmentSize ) * radius, -fHalfLength, cosf( (i+1) * segmentSize ) * radius);
+		glm::vec3 v1bottom( circle[i].x * radius, -fHalfLength, circle[i].y * radius);
+		glm::vec3 v2bottom( circle[i+1].x * radius, -fHalfLength, circle[i+1].y * radius);
 
 		if (transform != nullptr) {
 			v0top = glm::vec3((*transform * glm::vec4(v0top, 0)));
@@ -355,13 +1304,15 @@ void Gizmos::addRing(const glm::vec3& center, float innerRadius, float outerRadi
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
 
-	float fSegmentSize = (2 * glm::pi<float>()) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * glm::pi<float>(), getPixelRadius(tempCenter, outerRadius), sm_singleton->m_tessellationTolerance);
+	const glm::vec2* circle = getUnitCircle(segments);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
-		glm::vec3 v1outer( sinf( i * fSegmentSize ) * outerRadius, 0, cosf( i * fSegmentSize ) * outerRadius );
-		glm::vec3 v2outer( sinf( (i+1) * fSegmentSize ) * outerRadius, 0, cosf( (i+1) * fSegmentSize ) * outerRadius );
-		glm::vec3 v1inner( sinf( i * fSegmentSize ) * innerRadius, 0, cosf( i * fSegmentSize ) * innerRadius );
-		glm::vec3 v2inner( sinf( (i+1) * fSegmentSize ) * innerRadius, 0, cosf( (i+1) * fSegmentSize ) * innerRadius );
+		glm::vec3 v1outer( circle[i].x * outerRadius, 0, circle[i].y * outerRadius );
+		glm::vec3 v2outer( circle[i+1].x * outerRadius, 0, circle[i+1].y * outerRadius );
+		glm::vec3 v1inner( circle[i].x * innerRadius, 0, circle[i].y * innerRadius );
+		glm::vec3 v2inner( circle[i+1].x * innerRadius, 0, circle[i+1].y * innerRadius );
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -393,11 +1344,13 @@ void Gizmos::addDisk(const glm::vec3& center, float radius,
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
 
-	float fSegmentSize = (2 * glm::pi<float>()) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * glm::pi<float>(), getPixelRadius(tempCenter, radius), sm_singleton->m_tessellationTolerance);
+	const glm::vec2* circle = getUnitCircle(segments);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
-		glm::vec3 v1outer( sinf( i * fSegmentSize ) * radius, 0, cosf( i * fSegmentSize ) * radius );
-		glm::vec3 v2outer( sinf( (i+1) * fSegmentSize ) * radius, 0, cosf( (i+1) * fSegmentSize ) * radius );
+		glm::vec3 v1outer( circle[i].x * radius, 0, circle[i].y * radius );
+		glm::vec3 v2outer( circle[i+1].x * radius, 0, circle[i+1].y * radius );
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -424,11 +1377,15 @@ void Gizmos::addArc(const glm::vec3& center, float rotation,
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
 
-	float fSegmentSize = (2 * arcHalfAngle) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * arcHalfAngle, getPixelRadius(tempCenter, radius), sm_singleton->m_tessellationTolerance);
+
+	static thread_local std::vector<glm::vec2> arcScratch;
+	const glm::vec2* arc = getArc(rotation - arcHalfAngle, 2 * arcHalfAngle, segments, arcScratch);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
-		glm::vec3 v1outer( sinf( i * fSegmentSize - arcHalfAngle + rotation ) * radius, 0, cosf( i * fSegmentSize - arcHalfAngle + rotation ) * radius);
-		glm::vec3 v2outer( sinf( (i+1) * fSegmentSize - arcHalfAngle + rotation ) * radius, 0, cosf( (i+1) * fSegmentSize - arcHalfAngle + rotation ) * radius);
+		glm::vec3 v1outer( arc[i].x * radius, 0, arc[i].y * radius);
+		glm::vec3 v2outer( arc[i+1].x * radius, 0, arc[i+1].y * radius);
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -447,8 +1404,8 @@ void Gizmos::addArc(const glm::vec3& center, float rotation,
 
 	// edge lines
 	if (fillColour.w == 0) {
-		glm::vec3 v1outer( sinf( -arcHalfAngle + rotation ) * radius, 0, cosf( -arcHalfAngle + rotation ) * radius );
-		glm::vec3 v2outer( sinf( arcHalfAngle + rotation ) * radius, 0, cosf( arcHalfAngle + rotation ) * radius );
+		glm::vec3 v1outer( arc[0].x * radius, 0, arc[0].y * radius );
+		glm::vec3 v2outer( arc[segments].x * radius, 0, arc[segments].y * radius );
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -469,13 +1426,17 @@ void Gizmos::addArcRing(const glm::vec3& center, float rotation,
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
 
-	float fSegmentSize = (2 * arcHalfAngle) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * arcHalfAngle, getPixelRadius(tempCenter, outerRadius), sm_singleton->m_tessellationTolerance);
+
+	static thread_local std::vector<glm::vec2> arcScratch;
+	const glm::vec2* arc = getArc(rotation - arcHalfAngle, 2 * arcHalfAngle, segments, arcScratch);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
-		glm::vec3 v1outer( sinf( i * fSegmentSize - arcHalfAngle + rotation ) * outerRadius, 0, cosf( i * fSegmentSize - arcHalfAngle + rotation ) * outerRadius );
-		glm::vec3 v2outer( sinf( (i+1) * fSegmentSize - arcHalfAngle + rotation ) * outerRadius, 0, cosf( (i+1) * fSegmentSize - arcHalfAngle + rotation ) * outerRadius );
-		glm::vec3 v1inner( sinf( i * fSegmentSize - arcHalfAngle + rotation  ) * innerRadius, 0, cosf( i * fSegmentSize - arcHalfAngle + rotation  ) * innerRadius );
-		glm::vec3 v2inner( sinf( (i+1) * fSegmentSize - arcHalfAngle + rotation  ) * innerRadius, 0, cosf( (i+1) * fSegmentSize - arcHalfAngle + rotation  ) * innerRadius );
+		glm::vec3 v1outer( arc[i].x * outerRadius, 0, arc[i].y * outerRadius );
+		glm::vec3 v2outer( arc[i+1].x * outerRadius, 0, arc[i+1].y * outerRadius );
+		glm::vec3 v1inner( arc[i].x * innerRadius, 0, arc[i].y * innerRadius );
+		glm::vec3 v2inner( arc[i+1].x * innerRadius, 0, arc[i+1].y * innerRadius );
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -500,10 +1461,10 @@ void Gizmos::addArcRing(const glm::vec3& center, float rotation,
 
 	// edge lines
 	if (fillColour.w == 0) {
-		glm::vec3 v1outer( sinf( -arcHalfAngle + rotation ) * outerRadius, 0, cosf( -arcHalfAngle + rotation ) * outerRadius );
-		glm::vec3 v2outer( sinf( arcHalfAngle + rotation ) * outerRadius, 0, cosf( arcHalfAngle + rotation ) * outerRadius );
-		glm::vec3 v1inner( sinf( -arcHalfAngle + rotation  ) * innerRadius, 0, cosf( -arcHalfAngle + rotation  ) * innerRadius );
-		glm::vec3 v2inner( sinf( arcHalfAngle + rotation  ) * innerRadius, 0, cosf( arcHalfAngle + rotation  ) * innerRadius );
+		glm::vec3 v1outer( arc[0].x * outerRadius, 0, arc[0].y * outerRadius );
+		glm::vec3 v2outer( arc[segments].x * outerRadius, 0, arc[segments].y * outerRadius );
+		glm::vec3 v1inner( arc[0].x * innerRadius, 0, arc[0].y * innerRadius );
+		glm::vec3 v2inner( arc[segments].x * innerRadius, 0, arc[segments].y * innerRadius );
 
 		if (transform != nullptr) {
 			v1outer = glm::vec3((*transform * glm::vec4(v1outer, 0)));
@@ -517,16 +1478,38 @@ void Gizmos::addArcRing(const glm::vec3& center, float rotation,
 	}
 }
 
+// fills points with the (rows + 1) * columns points of a sphere, or part of one, from tables of the sine and cosine
+// of each latitude and longitude. points is reused between calls so spheres don't allocate
+static void buildSphere(std::vector<glm::vec3>& points, float radius, int rows, int columns, const glm::mat4* transform,
+						float longMin, float longitudinalRange, float latMin, float latitudinalRange) {
+
+	static thread_local std::vector<glm::vec2> latitudeScratch;
+	static thread_local std::vector<glm::vec2> longitudeScratch;
+	const glm::vec2* latitudes = getArc(latMin, latitudinalRange, rows, latitudeScratch);
+	const glm::vec2* longitudes = getArc(longMin, longitudinalRange, columns, longitudeScratch);
+
+	points.resize(rows * columns + columns);
+
+	for (int row = 0; row <= rows; ++row) {
+		// y ordinates this may be a little confusing but here we are navigating around the xAxis in GL
+		float y = radius * latitudes[row].x;
+		float z = radius * latitudes[row].y;
+
+		for (int col = 0; col <= columns; ++col) {
+			glm::vec3 point( -z * longitudes[col].x, y, -z * longitudes[col].y );
+
+			if (transform != nullptr)
+				point = glm::vec3((*transform * glm::vec4(point, 0)));
+
+			points[row * columns + (col % columns)] = point;
+		}
+	}
+}
+
 void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int columns, const glm::vec4& fillColour, 
 								const glm::mat4* transform, float longMin, float longMax, 
 								float latMin, float latMax) {
 
-	float inverseRadius = 1 / radius;
-
-	// invert these first as the multiply is slightly quicker
-	float invColumns = 1.0f / columns;
-	float invRows = 1.0f / rows;
-
 	float DEG2RAD = glm::pi<float>() / 180;
 
 	glm::vec3 tempCenter = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
@@ -535,31 +1518,21 @@ void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int colu
 	float latitiudinalRange = (latMax - latMin) * DEG2RAD;
 	float longitudinalRange = (longMax - longMin) * DEG2RAD;
 
-	// for each row of the mesh
-	glm::vec3* v4Array = new glm::vec3[rows*columns + columns];
-
-	for (int row = 0; row <= rows; ++row) {
-		// y ordinates this may be a little confusing but here we are navigating around the xAxis in GL
-		float ratioAroundXAxis = float(row) * invRows;
-		float radiansAboutXAxis  = ratioAroundXAxis * latitiudinalRange + (latMin * DEG2RAD);
-		float y  =  radius * sin(radiansAboutXAxis);
-		float z  =  radius * cos(radiansAboutXAxis);
-		
-		for ( int col = 0; col <= columns; ++col ) {
-			float ratioAroundYAxis   = float(col) * invColumns;
-			float theta = ratioAroundYAxis * longitudinalRange + (longMin * DEG2RAD);
-			glm::vec3 v4Point( -z * sinf(theta), y, -z * cosf(theta) );
-			glm::vec3 v4Normal( inverseRadius * v4Point.x, inverseRadius * v4Point.y, inverseRadius * v4Point.z);
-
-			if (transform != nullptr) {
-				v4Point = glm::vec3((*transform * glm::vec4(v4Point, 0)));
-				v4Normal = glm::vec3((*transform * glm::vec4(v4Normal, 0)));
-			}
+	if (sm_singleton != nullptr) {
+		float pixelRadius = getPixelRadius(tempCenter, radius);
+		rows = glm::min(rows, glm::max(2, (int)adaptSegments(rows, latitiudinalRange, pixelRadius, sm_singleton->m_tessellationTolerance)));
+		columns = glm::min(columns, glm::max(3, (int)adaptSegments(columns, longitudinalRange, pixelRadius, sm_singleton->m_tessellationTolerance)));
+	}
 
-			int index = row * columns + (col % columns);
-			v4Array[index] = v4Point;
-		}
+	// only whole spheres are instanced
+	if (sm_singleton != nullptr && sm_singleton->canInstance() &&
+		longMin == 0 && longMax == 360 && latMin == -90 && latMax == 90) {
+		sm_singleton->addInstance(MESH_SPHERE, rows, columns, getInstanceTransform(tempCenter, transform, glm::vec3(radius)), fillColour);
+		return;
 	}
+
+	static thread_local std::vector<glm::vec3> v4Array;
+	buildSphere(v4Array, radius, rows, columns, transform, longMin * DEG2RAD, longitudinalRange, latMin * DEG2RAD, latitiudinalRange);
 	
 	for (int face = 0; face < (rows)*(columns); ++face ) {
 		int iNextFace = face + 1;		
@@ -576,8 +1549,6 @@ void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int colu
 		addTri(tempCenter + v4Array[iNextFace+columns], tempCenter + v4Array[face], tempCenter + v4Array[iNextFace], fillColour);
 		addTri(tempCenter + v4Array[iNextFace+columns], tempCenter + v4Array[face+columns], tempCenter + v4Array[face], fillColour);
 	}
-
-	delete[] v4Array;	
 }
 
 void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
@@ -596,12 +1567,6 @@ void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
 	glm::vec3 topCenter = center + glm::vec3(top);
 	glm::vec3 bottomCenter = center + glm::vec3(bottom);
 
-	float inverseRadius = 1 / radius;
-
-	// invert these first as the multiply is slightly quicker
-	float invColumns = 1.0f / float(cols);
-	float invRows = 1.0f / float(rows);
-
 	float DEG2RAD = glm::pi<float>() / 180;
 	float latMin = -90, latMax = 90, longMin = 0.f, longMax = 360;
 
@@ -609,32 +1574,28 @@ void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
 	float latitiudinalRange = (latMax - latMin) * DEG2RAD;
 	float longitudinalRange = (longMax - longMin) * DEG2RAD;
 
-	// for each row of the mesh
-	glm::vec3* v4Array = new glm::vec3[rows*cols + cols];
+	// the rows are split between the two halves, so keep an even number of them
+	if (sm_singleton != nullptr) {
+		float pixelRadius = getPixelRadius((topCenter + bottomCenter) * 0.5f, radius);
+		rows = glm::min(rows, glm::max(2, (int)adaptSegments(rows, latitiudinalRange, pixelRadius, sm_singleton->m_tessellationTolerance)));
+		rows += rows % 2;
+		cols = (int)adaptSegments(cols, longitudinalRange, pixelRadius, sm_singleton->m_tessellationTolerance);
+	}
 
-	for (int row = 0; row <= (rows); ++row) {
-		// y ordinates this may be a little confusing but here we are navigating around the xAxis in GL
-		float ratioAroundXAxis = float(row) * invRows;
-		float radiansAboutXAxis = ratioAroundXAxis * latitiudinalRange + (latMin * DEG2RAD);
-		float y = radius * sin(radiansAboutXAxis);
-		float z = radius * cos(radiansAboutXAxis);
-
-		for (int col = 0; col <= cols; ++col) {
-			float ratioAroundYAxis = float(col) * invColumns;
-			float theta = ratioAroundYAxis * longitudinalRange + (longMin * DEG2RAD);
-			glm::vec3 v4Point(-z * sinf(theta), y, -z * cosf(theta));
-			glm::vec3 v4Normal(inverseRadius * v4Point.x, inverseRadius * v4Point.y, inverseRadius * v4Point.z);
-
-			if (rotation != nullptr) {
-				v4Point = glm::vec3((*rotation * glm::vec4(v4Point, 0)));
-				v4Normal = glm::vec3((*rotation * glm::vec4(v4Normal, 0)));
-			}
+	// instanced as two hemispheres joined by an open tube
+	if (sm_singleton != nullptr && sm_singleton->canInstance()) {
+		glm::vec3 middle = rotation != nullptr ? center + glm::vec3((*rotation)[3]) : center;
+		unsigned int halfRows = glm::max(rows / 2, 1);
 
-			int index = row * cols + (col % cols);
-			v4Array[index] = v4Point;
-		}
+		sm_singleton->addInstance(MESH_HEMISPHERE_TOP, halfRows, cols, getInstanceTransform(topCenter, rotation, glm::vec3(radius)), fillColour);
+		sm_singleton->addInstance(MESH_HEMISPHERE_BOTTOM, halfRows, cols, getInstanceTransform(bottomCenter, rotation, glm::vec3(radius)), fillColour);
+		sm_singleton->addInstance(MESH_TUBE, cols, 0, getInstanceTransform(middle, rotation, glm::vec3(radius, sphereCenters, radius)), fillColour);
+		return;
 	}
 
+	static thread_local std::vector<glm::vec3> v4Array;
+	buildSphere(v4Array, radius, rows, cols, rotation, longMin * DEG2RAD, longitudinalRange, latMin * DEG2RAD, latitiudinalRange);
+
 	// create a sphere that is split in two
 	for (int face = 0; face < (rows)*(cols); ++face) {
 		int iNextFace = face + 1;
@@ -656,16 +1617,11 @@ void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
 		addTri(tempCenter + v4Array[iNextFace + cols], tempCenter + v4Array[face + cols], tempCenter + v4Array[face], fillColour);
 	}
 
-	delete[] v4Array;
+	const glm::vec2* circle = getUnitCircle(cols);
 
 	for (int i = 0; i < cols; ++i) {
-		float x = (float)i / (float)cols;
-		float x1 = (float)(i+1) / (float)cols;
-		x *= 2.0f * glm::pi<float>();
-		x1 *= 2.0f * glm::pi<float>();
-
-		glm::vec3 pos = glm::vec3(cosf(x), 0, sinf(x)) * radius;
-		glm::vec3 pos1 = glm::vec3(cosf(x1), 0, sinf(x1)) * radius;
+		glm::vec3 pos = glm::vec3(circle[i].y, 0, circle[i].x) * radius;
+		glm::vec3 pos1 = glm::vec3(circle[i+1].y, 0, circle[i+1].x) * radius;
 
 		if (rotation) {
 			pos = glm::vec3((*rotation) * glm::vec4(pos,0));
@@ -711,7 +1667,7 @@ void Gizmos::addLine(const glm::vec3& v0,  const glm::vec3& v1, const glm::vec4&
 void Gizmos::addLine(const glm::vec3& v0, const glm::vec3& v1, const glm::vec4& colour0, const glm::vec4& colour1) {
 
 	if (sm_singleton != nullptr &&
-		sm_singleton->m_lineCount < sm_singleton->m_maxLines) {
+		sm_singleton->reserve(BUFFER_LINES, sm_singleton->m_lineCount, 1) == 1) {
 		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.x = v0.x;
 		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.y = v0.y;
 		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.z = v0.z;
@@ -737,7 +1693,7 @@ void Gizmos::addLine(const glm::vec3& v0, const glm::vec3& v1, const glm::vec4&
 void Gizmos::addTri(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& colour) {
 	if (sm_singleton != nullptr) {
 		if (colour.w == 1) {
-			if (sm_singleton->m_triCount < sm_singleton->m_maxTris) {
+			if (sm_singleton->reserve(BUFFER_TRIS, sm_singleton->m_triCount, 1) == 1) {
 				sm_singleton->m_tris[sm_singleton->m_triCount].v0.x = v0.x;
 				sm_singleton->m_tris[sm_singleton->m_triCount].v0.y = v0.y;
 				sm_singleton->m_tris[sm_singleton->m_triCount].v0.z = v0.z;
@@ -768,7 +1724,7 @@ void Gizmos::addTri(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v
 			}
 		}
 		else {
-			if (sm_singleton->m_transparentTriCount < sm_singleton->m_maxTris) {
+			if (sm_singleton->reserve(BUFFER_TRANSPARENT_TRIS, sm_singleton->m_transparentTriCount, 1) == 1) {
 				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.x = v0.x;
 				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.y = v0.y;
 				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.z = v0.z;
@@ -845,11 +1801,13 @@ void Gizmos::add2DCircle(const glm::vec2& center, float radius, unsigned int seg
 	glm::vec4 solidColour = colour;
 	solidColour.w = 1;
 
-	float segmentSize = (2 * glm::pi<float>()) / segments;
+	if (sm_singleton != nullptr)
+		segments = adaptSegments(segments, 2 * glm::pi<float>(), get2DPixelRadius(radius), sm_singleton->m_2DtessellationTolerance);
+	const glm::vec2* circle = getUnitCircle(segments);
 
 	for ( unsigned int i = 0 ; i < segments ; ++i ) {
-		glm::vec2 v1outer( sinf( i * segmentSize ) * radius, cosf( i * segmentSize ) * radius );
-		glm::vec2 v2outer( sinf( (i+1) * segmentSize ) * radius, cosf( (i+1) * segmentSize ) * radius );
+		glm::vec2 v1outer = circle[i] * radius;
+		glm::vec2 v2outer = circle[i+1] * radius;
 
 		if (transform != nullptr) {
 			v1outer = glm::vec2((*transform * glm::vec4(v1outer,0,0)));
@@ -867,31 +1825,39 @@ void Gizmos::add2DCircle(const glm::vec2& center, float radius, unsigned int seg
 	}
 }
 
+void Gizmos::add2DCircleInstanced(const glm::vec2& center, float radius, const glm::vec4& colour, float thickness /*= 0*/) {
+	if (sm_singleton == nullptr)
+		return;
+
+	unsigned int count = 1;
+	GizmoCircle* circle = sm_singleton->allocate2DCircles(count);
+	if (count == 1) {
+		// written field by field as the instance may be in write-combined GPU memory
+		circle->x = center.x;
+		circle->y = center.y;
+		circle->radius = radius;
+		circle->thickness = thickness;
+		circle->colour = packColour(colour);
+	}
+}
+
 void Gizmos::add2DLine(const glm::vec2& rv0,  const glm::vec2& rv1, const glm::vec4& colour) {
 	add2DLine(rv0,rv1,colour,colour);
 }
 
 void Gizmos::add2DLine(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec4& colour0, const glm::vec4& colour1) {
-	if (sm_singleton != nullptr &&
-		sm_singleton->m_2DlineCount < sm_singleton->m_max2DLines) {
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.x = rv0.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.y = rv0.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.r = colour0.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.g = colour0.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.b = colour0.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.a = colour0.a;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.x = rv1.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.y = rv1.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.r = colour1.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.g = colour1.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.b = colour1.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.a = colour1.a;
-
-		sm_singleton->m_2DlineCount++;
+	if (sm_singleton == nullptr)
+		return;
+
+	unsigned int count = 1;
+	Gizmo2DLine* line = sm_singleton->allocate2DLines(count);
+	if (count == 1) {
+		line->v0.x = rv0.x;
+		line->v0.y = rv0.y;
+		line->v0.colour = packColour(colour0);
+		line->v1.x = rv1.x;
+		line->v1.y = rv1.y;
+		line->v1.colour = packColour(colour1);
 	}
 }
 
@@ -900,35 +1866,65 @@ void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec
 }
 
 void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec2& rv2, const glm::vec4& colour0, const glm::vec4& colour1, const glm::vec4& colour2) {
-	if (sm_singleton != nullptr) {
-		if (sm_singleton->m_2DtriCount < sm_singleton->m_max2DTris) {
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.x = rv0.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.y = rv0.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.x = rv1.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.y = rv1.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.x = rv2.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.y = rv2.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.r = colour0.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.g = colour0.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.b = colour0.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.a = colour0.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.r = colour1.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.g = colour1.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.b = colour1.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.a = colour1.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.r = colour2.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.g = colour2.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.b = colour2.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.a = colour2.a;
-
-			sm_singleton->m_2DtriCount++;
-		}
+	if (sm_singleton == nullptr)
+		return;
+
+	unsigned int count = 1;
+	Gizmo2DTri* tri = sm_singleton->allocate2DTris(count);
+	if (count == 1) {
+		tri->v0.x = rv0.x;
+		tri->v0.y = rv0.y;
+		tri->v0.colour = packColour(colour0);
+		tri->v1.x = rv1.x;
+		tri->v1.y = rv1.y;
+		tri->v1.colour = packColour(colour1);
+		tri->v2.x = rv2.x;
+		tri->v2.y = rv2.y;
+		tri->v2.colour = packColour(colour2);
+	}
+}
+
+void Gizmos::add2DLines(const Gizmo2DVertex* vertices, unsigned int lineCount) {
+	if (sm_singleton == nullptr)
+		return;
+
+	Gizmo2DLine* lines = sm_singleton->allocate2DLines(lineCount);
+	memcpy(lines, vertices, lineCount * sizeof(Gizmo2DLine));
+}
+
+void Gizmos::add2DLines(const glm::vec2* points, unsigned int lineCount, const glm::vec4& colour) {
+	if (sm_singleton == nullptr)
+		return;
+
+	Gizmo2DVertex* vertex = (Gizmo2DVertex*)sm_singleton->allocate2DLines(lineCount);
+	unsigned int packed = packColour(colour);
+
+	for (unsigned int i = 0; i < lineCount * 2; ++i) {
+		vertex[i].x = points[i].x;
+		vertex[i].y = points[i].y;
+		vertex[i].colour = packed;
+	}
+}
+
+void Gizmos::add2DTris(const Gizmo2DVertex* vertices, unsigned int triCount) {
+	if (sm_singleton == nullptr)
+		return;
+
+	Gizmo2DTri* tris = sm_singleton->allocate2DTris(triCount);
+	memcpy(tris, vertices, triCount * sizeof(Gizmo2DTri));
+}
+
+void Gizmos::add2DTris(const glm::vec2* points, unsigned int triCount, const glm::vec4& colour) {
+	if (sm_singleton == nullptr)
+		return;
+
+	Gizmo2DVertex* vertex = (Gizmo2DVertex*)sm_singleton->allocate2DTris(triCount);
+	unsigned int packed = packColour(colour);
+
+	for (unsigned int i = 0; i < triCount * 3; ++i) {
+		vertex[i].x = points[i].x;
+		vertex[i].y = points[i].y;
+		vertex[i].colour = packed;
 	}
 }
 
@@ -940,61 +1936,80 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 	if ( sm_singleton != nullptr && 
 		(sm_singleton->m_lineCount > 0 || 
 		 sm_singleton->m_triCount > 0 || 
-		 sm_singleton->m_transparentTriCount > 0)) {
-		int shader = 0;
-		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
+		 sm_singleton->m_transparentTriCount > 0 ||
+		 sm_singleton->m_instanceCount > 0 ||
+		 sm_singleton->m_layers.empty() == false)) {
+		// sort the transparent triangles into the stream buffer while everything else is drawn
+		bool sorting = false;
+		if (sm_singleton->m_sortTransparent &&
+			sm_singleton->m_transparentTriCount > 0) {
+			glm::vec4 depthRow(projectionView[0][2], projectionView[1][2], projectionView[2][2], projectionView[3][2]);
+			GizmoTri* sorted = (GizmoTri*)sm_singleton->m_buffers[BUFFER_TRANSPARENT_TRIS].stream->getWritePointer();
+
+			sorting = sm_singleton->m_transparentTriCount >= asyncSortThreshold;
+			if (sorting)
+				sm_singleton->startSort(depthRow, sorted);
+			else
+				sm_singleton->sortTransparentTris(depthRow, sorted);
+		}
 
-		glUseProgram(sm_singleton->m_shader);
-		
-		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
-		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projectionView));
+		GLState::State state = GLState::get();
+
+		GLState::useProgram(sm_singleton->m_shader);
+		glUniformMatrix4fv(sm_singleton->m_projectionViewUniform, 1, false, glm::value_ptr(projectionView));
+
+		sm_singleton->drawLayers(BUFFER_LINES);
+		sm_singleton->drawLayers(BUFFER_TRIS);
 
 		if (sm_singleton->m_lineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_lineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_lineCount * sizeof(GizmoLine), sm_singleton->m_lines);
+			sm_singleton->m_buffers[BUFFER_LINES].stream->flush(sm_singleton->m_lineCount * sizeof(GizmoLine));
 
-			glBindVertexArray(sm_singleton->m_lineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_lineCount * 2);
+			GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_LINES].vao);
+			glDrawArrays(GL_LINES, (GLint)(sm_singleton->m_buffers[BUFFER_LINES].stream->getDrawOffset() / sizeof(GizmoVertex)), sm_singleton->m_lineCount * 2);
 		}
 
 		if (sm_singleton->m_triCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_triVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_triCount * sizeof(GizmoTri), sm_singleton->m_tris);
+			sm_singleton->m_buffers[BUFFER_TRIS].stream->flush(sm_singleton->m_triCount * sizeof(GizmoTri));
+
+			GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_TRIS].vao);
+			glDrawArrays(GL_TRIANGLES, (GLint)(sm_singleton->m_buffers[BUFFER_TRIS].stream->getDrawOffset() / sizeof(GizmoVertex)), sm_singleton->m_triCount * 3);
+		}
+
+		bool transparentInstances = false;
+		if (sm_singleton->m_instanceCount > 0) {
+			sm_singleton->uploadInstances();
+			sm_singleton->drawInstances(projectionView, false);
+			GLState::useProgram(sm_singleton->m_shader);
 
-			glBindVertexArray(sm_singleton->m_triVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_triCount * 3);
+			for (auto& mesh : sm_singleton->m_meshes)
+				transparentInstances = transparentInstances || mesh.second->transparent.empty() == false;
 		}
 		
-		if (sm_singleton->m_transparentTriCount > 0) {
-			// not ideal to store these, but Gizmos must work stand-alone
-			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
-			GLboolean depthMask = GL_TRUE;
-			glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
-			int src, dst;
-			glGetIntegerv(GL_BLEND_SRC, &src);
-			glGetIntegerv(GL_BLEND_DST, &dst);
-			
+		if (sm_singleton->m_transparentTriCount > 0 ||
+			sm_singleton->getLayerCount(BUFFER_TRANSPARENT_TRIS) > 0 ||
+			transparentInstances) {
 			// setup blend states
-			if (blendEnabled == GL_FALSE)
-				glEnable(GL_BLEND);
-			
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			glDepthMask(GL_FALSE);
-
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_transparentTriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_transparentTriCount * sizeof(GizmoTri), sm_singleton->m_transparentTris);
-
-			glBindVertexArray(sm_singleton->m_transparentTriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_transparentTriCount * 3);
-
-			// reset state
-			glDepthMask(depthMask);
-			glBlendFunc(src, dst);
-			if (blendEnabled == GL_FALSE)
-				glDisable(GL_BLEND);
+			GLState::setBlend(true);
+			GLState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			GLState::setDepthMask(false);
+
+			sm_singleton->drawLayers(BUFFER_TRANSPARENT_TRIS);
+
+			if (sm_singleton->m_transparentTriCount > 0) {
+				if (sorting)
+					sm_singleton->finishSort();
+
+				sm_singleton->m_buffers[BUFFER_TRANSPARENT_TRIS].stream->flush(sm_singleton->m_transparentTriCount * sizeof(GizmoTri));
+
+				GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_TRANSPARENT_TRIS].vao);
+				glDrawArrays(GL_TRIANGLES, (GLint)(sm_singleton->m_buffers[BUFFER_TRANSPARENT_TRIS].stream->getDrawOffset() / sizeof(GizmoVertex)), sm_singleton->m_transparentTriCount * 3);
+			}
+
+			if (transparentInstances)
+				sm_singleton->drawInstances(projectionView, true);
 		}
 
-		glUseProgram(shader);
+		GLState::restore(state);
 	}
 }
 
@@ -1003,57 +2018,72 @@ void Gizmos::draw2D(float screenWidth, float screenHeight) {
 }
 
 void Gizmos::draw2D(const glm::mat4& projection) {
+	if (sm_singleton != nullptr)
+		sm_singleton->mergeThreadBuffers();
+
 	if ( sm_singleton != nullptr && 
 		(sm_singleton->m_2DlineCount > 0 || 
-		 sm_singleton->m_2DtriCount > 0)) {
-		int shader = 0;
-		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
+		 sm_singleton->m_2DtriCount > 0 ||
+		 sm_singleton->m_2DcircleCount > 0 ||
+		 sm_singleton->m_layers.empty() == false)) {
+		GLState::State state = GLState::get();
 
-		glUseProgram(sm_singleton->m_shader);
-		
-		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
-		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projection));
+		GLState::useProgram(sm_singleton->m_2Dshader);
+		glUniformMatrix4fv(sm_singleton->m_2DprojectionViewUniform, 1, false, glm::value_ptr(projection));
+
+		sm_singleton->drawLayers(BUFFER_2D_LINES);
 
 		if (sm_singleton->m_2DlineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DlineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DlineCount * sizeof(GizmoLine), sm_singleton->m_2Dlines);
+			sm_singleton->m_buffers[BUFFER_2D_LINES].stream->flush(sm_singleton->m_2DlineCount * sizeof(Gizmo2DLine));
 
-			glBindVertexArray(sm_singleton->m_2DlineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_2DlineCount * 2);
+			GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_2D_LINES].vao);
+			glDrawArrays(GL_LINES, (GLint)(sm_singleton->m_buffers[BUFFER_2D_LINES].stream->getDrawOffset() / sizeof(Gizmo2DVertex)), sm_singleton->m_2DlineCount * 2);
 		}
 
-		if (sm_singleton->m_2DtriCount > 0) {
-			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
-
-			GLboolean depthMask = GL_TRUE;
-			glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
-
-			int src, dst;
-			glGetIntegerv(GL_BLEND_SRC, &src);
-			glGetIntegerv(GL_BLEND_DST, &dst);
-
-			if (blendEnabled == GL_FALSE)
-				glEnable(GL_BLEND);
+		if (sm_singleton->m_2DtriCount > 0 ||
+			sm_singleton->getLayerCount(BUFFER_2D_TRIS) > 0) {
+			GLState::setBlend(true);
+			GLState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			GLState::setDepthMask(false);
 
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			sm_singleton->drawLayers(BUFFER_2D_TRIS);
 
-			glDepthMask(GL_FALSE);
+			if (sm_singleton->m_2DtriCount > 0) {
+				sm_singleton->m_buffers[BUFFER_2D_TRIS].stream->flush(sm_singleton->m_2DtriCount * sizeof(Gizmo2DTri));
 
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DtriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DtriCount * sizeof(GizmoTri), sm_singleton->m_2Dtris);
-
-			glBindVertexArray(sm_singleton->m_2DtriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_2DtriCount * 3);
-
-			glDepthMask(depthMask);
-
-			glBlendFunc(src, dst);
+				GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_2D_TRIS].vao);
+				glDrawArrays(GL_TRIANGLES, (GLint)(sm_singleton->m_buffers[BUFFER_2D_TRIS].stream->getDrawOffset() / sizeof(Gizmo2DVertex)), sm_singleton->m_2DtriCount * 3);
+			}
+		}
 
-			if (blendEnabled == GL_FALSE)
-				glDisable(GL_BLEND);
+		if (sm_singleton->m_2DcircleCount > 0 ||
+			sm_singleton->getLayerCount(BUFFER_2D_CIRCLES) > 0) {
+			// the edges are anti-aliased with alpha, and the quads may be flipped by the projection
+			GLState::setBlend(true);
+			GLState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			GLState::setCullFace(false);
+			GLState::setDepthMask(false);
+
+			GLState::useProgram(sm_singleton->m_circleShader);
+			glUniformMatrix4fv(sm_singleton->m_circleProjectionViewUniform, 1, false, glm::value_ptr(projection));
+
+			sm_singleton->drawLayers(BUFFER_2D_CIRCLES);
+
+			if (sm_singleton->m_2DcircleCount > 0) {
+				StreamBuffer* stream = sm_singleton->m_buffers[BUFFER_2D_CIRCLES].stream;
+				stream->flush(sm_singleton->m_2DcircleCount * sizeof(GizmoCircle));
+
+				// instanced attributes ignore the first vertex, so point them at this frame's section instead
+				size_t offset = stream->getDrawOffset();
+				GLState::bindVertexArray(sm_singleton->m_buffers[BUFFER_2D_CIRCLES].vao);
+				GLState::bindArrayBuffer(stream->getBuffer());
+				glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoCircle), (void*)offset);
+				glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GizmoCircle), (void*)(offset + 16));
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, sm_singleton->m_2DcircleCount);
+			}
 		}
 
-		glUseProgram(shader);
+		GLState::restore(state);
 	}
 }
 
@@ -1,17 +1,90 @@
 #pragma once
 
 #include <glm/fwd.hpp>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace aie {
 
-// a singleton class for rendering immediate-mode 3-D primitives
+class StreamBuffer;
+
+// a singleton class for rendering immediate-mode 3-D primitives.
+// 2D gizmos may also be added from other threads. each thread appends to its own buffer without locking,
+// and draw2D() merges them in, so those threads must not be adding gizmos during clear() or draw2D()
 class Gizmos {
 public:
 
-	static void		create(unsigned int maxLines, unsigned int maxTris,
-						   unsigned int max2DLines, unsigned int max2DTris);
+	// the packed vertex used by 2D lines and triangles, 12 bytes each. colours are RGBA8, see packColour()
+	struct Gizmo2DVertex {
+		float x, y;
+		unsigned int colour;
+	};
+
+	static unsigned int	packColour(const glm::vec4& colour);
+
+	// the buffers that each type of primitive is written to
+	enum BufferType : unsigned int {
+		BUFFER_LINES = 0,
+		BUFFER_TRIS,
+		BUFFER_TRANSPARENT_TRIS,
+		BUFFER_2D_LINES,
+		BUFFER_2D_TRIS,
+		BUFFER_2D_CIRCLES,
+		BUFFER_TYPE_COUNT,
+	};
+
+	struct BufferStats {
+		unsigned int	capacity;		// primitives the buffer holds before it next grows
+		unsigned int	highWaterMark;	// most primitives added in a single frame
+		unsigned int	overflowCount;	// primitives dropped because the buffer was full, see create()
+		unsigned int	resizeCount;	// times the buffer has grown or shrunk
+	};
+
+	// the capacities given are each buffer's starting size. a buffer that fills up doubles in size at the start of
+	// the next frame, and anything that didn't fit is dropped for that frame, so the sizes only need to cover a typical frame
+	static void		create(unsigned int lineCapacity, unsigned int triCapacity,
+						   unsigned int line2DCapacity, unsigned int tri2DCapacity,
+						   unsigned int circle2DCapacity = 1024);
 	static void		destroy();
 
+	// buffers never grow past maxCapacity primitives, anything added past that is dropped and counted as an overflow.
+	// if shrink is true a buffer halves (down to its starting size) after using less than a quarter of its capacity
+	// for shrinkFrames frames in a row
+	static void		setGrowth(unsigned int maxCapacity, bool shrink = false, unsigned int shrinkFrames = 300);
+
+	static const BufferStats&	getBufferStats(BufferType type);
+
+	// adaptive tessellation treats the segments, rows and columns given to curved gizmos as a maximum, using fewer for
+	// curves that are small on screen while keeping every segment within tolerance pixels of the true curve. a shape's
+	// size on screen comes from the camera and viewport height given, so set them each frame before adding gizmos.
+	// a tolerance of 0 turns it off, which is the default
+	static void		setTessellation(const glm::mat4& projection, const glm::mat4& view, float viewportHeight, float tolerance = 0.5f);
+	static void		set2DTessellation(const glm::mat4& projection, float viewportHeight, float tolerance = 0.5f);
+
+	// full spheres, capsules, filled cylinders and filled boxes are drawn as instances of unit meshes that are
+	// built once per shape and resolution, so adding one only stores its transform and colour. shapes added to a
+	// retained layer are always built from triangles and lines. disabling instancing builds all of them that way
+	static void		setInstancing(bool enabled);
+
+	// transparent triangles are drawn in the order they were added unless sorting is enabled. they're then kept in
+	// CPU memory and sorted back to front by the depth of their centres, on a worker thread while the opaque gizmos
+	// draw. transparent instanced shapes are added as triangles while sorting so that they're sorted too. if transparent
+	// triangles have already been added this frame, sorting is turned on or off from the start of the next frame
+	static void		setTransparentSorting(bool enabled);
+
+	// retained layers hold gizmos that are uploaded once and then drawn every frame, before that frame's
+	// gizmos, until the layer is invalidated. gizmos added on the render thread between beginLayer() and
+	// endLayer() go into the layer instead of the current frame. beginning an existing layer rebuilds it.
+	// a layer's transparent triangles are drawn in the order they were added, as layers are never sorted
+	static bool		hasLayer(const char* name);
+	static void		beginLayer(const char* name);
+	static void		endLayer();
+	static void		invalidateLayer(const char* name);
+
 	// removes all Gizmos
 	static void		clear();
 
@@ -90,13 +163,89 @@ public:
 	static void		add2DAABB(const glm::vec2& center, const glm::vec2& extents, const glm::vec4& colour, const glm::mat4* transform = nullptr);	
 	static void		add2DAABBFilled(const glm::vec2& center, const glm::vec2& extents, const glm::vec4& colour, const glm::mat4* transform = nullptr);	
 	static void		add2DCircle(const glm::vec2& center, float radius, unsigned int segments, const glm::vec4& colour, const glm::mat4* transform = nullptr);
+
+	// bulk 2D gizmos, adding lineCount lines from 2 vertices each or triCount triangles from 3 vertices each.
+	// the packed versions are copied straight into the buffer
+	static void		add2DLines(const Gizmo2DVertex* vertices, unsigned int lineCount);
+	static void		add2DLines(const glm::vec2* points, unsigned int lineCount, const glm::vec4& colour);
+	static void		add2DTris(const Gizmo2DVertex* vertices, unsigned int triCount);
+	static void		add2DTris(const glm::vec2* points, unsigned int triCount, const glm::vec4& colour);
+
+	// adds a circle drawn as a single instance and shaded with a signed distance function, so it is smooth at any size.
+	// if thickness == 0 the circle is filled, otherwise only an outline of that thickness is drawn inside the radius
+	static void		add2DCircleInstanced(const glm::vec2& center, float radius, const glm::vec4& colour, float thickness = 0);
 	
 private:
 
-	Gizmos(unsigned int maxLines, unsigned int maxTris,
-		   unsigned int max2DLines, unsigned int max2DTris);
+	Gizmos(unsigned int lineCapacity, unsigned int triCapacity,
+		   unsigned int line2DCapacity, unsigned int tri2DCapacity,
+		   unsigned int circle2DCapacity);
 	~Gizmos();
 
+	// makes room for count more primitives after the used ones already added this frame. returns how many of them
+	// fit, counting the rest as an overflow. the primitives already written to a stream buffer can't be read back from
+	// its write-only mapping, so it grows to fit them at the start of the next frame. staged primitives grow straight away
+	unsigned int	reserve(BufferType type, unsigned int used, unsigned int count);
+
+	// replaces a buffer's storage with room for capacity primitives. only staged primitives are kept
+	void			resize(BufferType type, unsigned int capacity);
+
+	// the radius in pixels that a 3D or 2D curve will be drawn at, or -1 if adaptive tessellation is off
+	static float	getPixelRadius(const glm::vec3& center, float radius);
+	static float	get2DPixelRadius(float radius);
+
+	// the fewest segments, up to the number given, that draw a curve through angle radians within the tolerance
+	static unsigned int	adaptSegments(unsigned int segments, float angle, float pixelRadius, float tolerance);
+
+	// the unit meshes that 3D shapes are instanced from
+	enum MeshType : unsigned int {
+		MESH_SPHERE = 0,
+		MESH_HEMISPHERE_TOP,
+		MESH_HEMISPHERE_BOTTOM,
+		MESH_CYLINDER,
+		MESH_TUBE,
+		MESH_BOX,
+	};
+
+	struct GizmoMesh;
+
+	// returns the unit mesh of a shape at a resolution, building it the first time
+	GizmoMesh*		getMesh(MeshType type, unsigned int resolution0, unsigned int resolution1);
+
+	// true if a 3D shape can be added as an instance rather than as triangles and lines
+	bool			canInstance() const;
+
+	// adds an instance of a unit mesh, its triangles take the colour and its lines are white
+	void			addInstance(MeshType type, unsigned int resolution0, unsigned int resolution1,
+								const glm::mat4& transform, const glm::vec4& colour);
+
+	// copies this frame's instances into the instance stream buffer, then draws either the opaque instances
+	// and every instance's lines, or the transparent instances' triangles
+	void			uploadInstances();
+	void			drawInstances(const glm::mat4& projectionView, bool transparent);
+
+	// sets up a vertex array to read a type of primitive from a buffer
+	void			setVertexLayout(BufferType type, unsigned int vao, unsigned int buffer);
+
+	// the number of primitives of a type added this frame
+	unsigned int&	getCount(BufferType type);
+
+	// draws every layer's primitives of a type, or returns how many there are
+	void			drawLayers(BufferType type);
+	unsigned int	getLayerCount(BufferType type) const;
+
+	// fetches the pointers that primitives are written to from each buffer
+	void			updateWritePointers();
+
+	// where a type of primitive is written this frame, which is the stream buffer unless it's staged or captured in CPU memory
+	char*			getWriteData(BufferType type);
+
+	// while capturing, every type of primitive is written to CPU memory instead of this frame's buffers, as the stream
+	// buffers can't be read back from. the frame's own counts are put aside until the capture ends, which returns the
+	// count of each type captured. the primitives stay in m_captured until the next capture begins
+	void			beginCapture();
+	void			endCapture(unsigned int* counts);
+
 	struct GizmoVertex {
 		float x, y, z, w;
 		float r, g, b, a;
@@ -113,45 +262,162 @@ private:
 		GizmoVertex v2;
 	};
 
+	struct Gizmo2DLine {
+		Gizmo2DVertex v0;
+		Gizmo2DVertex v1;
+	};
+
+	struct Gizmo2DTri {
+		Gizmo2DVertex v0;
+		Gizmo2DVertex v1;
+		Gizmo2DVertex v2;
+	};
+
+	struct GizmoCircle {
+		float x, y;
+		float radius, thickness;
+		unsigned int colour;	// RGBA8
+	};
+
+	// 2D primitives added by a thread other than the one that created the Gizmos
+	struct ThreadBuffer;
+	static ThreadBuffer*	getThreadBuffer();
+
+	// copies every thread's 2D primitives into the stream buffers, or discards them
+	void			mergeThreadBuffers();
+	void			clearThreadBuffers();
+
+	// returns where to write count 2D primitives, either this thread's buffer or the end of the
+	// stream buffer, which grows if needed. count is reduced to how many fit
+	Gizmo2DLine*	allocate2DLines(unsigned int& count);
+	Gizmo2DTri*		allocate2DTris(unsigned int& count);
+	GizmoCircle*	allocate2DCircles(unsigned int& count);
+
+	// writes this frame's transparent triangles to sorted in back to front order, by the depth of each triangle's
+	// centre along depthRow. that's the third row of the projection-view matrix, giving clip-space z, which grows
+	// with distance under both perspective and orthographic projections
+	void			sortTransparentTris(const glm::vec4& depthRow, GizmoTri* sorted);
+
+	// hands a sort to the worker thread, starting it the first time, and waits for the worker to finish it
+	void			startSort(const glm::vec4& depthRow, GizmoTri* sorted);
+	void			finishSort();
+	void			sortWork();
+
+	// turns sorting on or off as requested, once no transparent triangles have been added this frame
+	void			updateTransparentSorting();
+
+	// a retained layer's copy of each type of primitive, in static buffers
+	struct GizmoLayer {
+		std::string		name;
+		unsigned int	buffers[BUFFER_TYPE_COUNT];
+		unsigned int	vaos[BUFFER_TYPE_COUNT];
+		unsigned int	counts[BUFFER_TYPE_COUNT];
+	};
+
+	struct GizmoInstance {
+		float			transform[16];
+		unsigned int	colour;	// RGBA8
+	};
+
+	struct GizmoBuffer {
+		StreamBuffer*	stream;
+		unsigned int	vao;
+		unsigned int	capacity;
+		unsigned int	startCapacity;
+		size_t			primitiveSize;
+		unsigned int	lowUsageFrames;	// frames in a row using under a quarter of the capacity
+		unsigned int	growCapacity;	// the capacity to grow to at the start of the next frame, or 0
+		unsigned int	droppedCounter;	// Counters id
+		BufferStats		stats;
+	};
+
 	unsigned int	m_shader;
+	int				m_projectionViewUniform;
+
+	// 2D lines and triangles use their own shader for the packed vertex format
+	unsigned int	m_2Dshader;
+	int				m_2DprojectionViewUniform;
+
+	// primitives are written directly into the current frame's section of each stream buffer,
+	// so the line and triangle pointers below are updated by clear() every frame, and when a buffer grows
+	GizmoBuffer		m_buffers[BUFFER_TYPE_COUNT];
+
+	std::vector<GizmoLayer>	m_layers;
+
+	// the layer being recorded (or -1), which captures its primitives
+	int				m_recordingLayer;
+
+	bool				m_capturing;
+	std::vector<char>	m_captured[BUFFER_TYPE_COUNT];
+	unsigned int		m_frameCounts[BUFFER_TYPE_COUNT];
+
+	// adaptive tessellation settings. the clip-space w of a point is the dot product of the projection-view matrix's
+	// bottom row with it, and a radius r at that point covers r * scale / w pixels
+	float			m_tessellationRow[4];
+	float			m_tessellationScale;
+	float			m_tessellationTolerance;
+	float			m_2DtessellationScale;
+	float			m_2DtessellationTolerance;
+
+	// instanced unit meshes, keyed by shape and resolution
+	std::unordered_map<unsigned long long, GizmoMesh*>	m_meshes;
+
+	unsigned int	m_instanceShader;
+	int				m_instanceProjectionViewUniform;
+
+	StreamBuffer*	m_instanceStream;
+	unsigned int	m_instanceCapacity;
+	unsigned int	m_instanceCount;
+
+	bool			m_instancing;
+
+	// transparent triangles are staged here while sorting is enabled, along with the sort's working memory
+	bool						m_sortTransparent;
+	bool						m_sortTransparentNext;	// the setting to change to once it can
+	std::vector<GizmoTri>		m_transparentStaging;
+	std::vector<float>			m_sortDepths;
+	std::vector<unsigned long long>	m_sortItems;
+	std::vector<unsigned long long>	m_sortScratch;
+
+	// the worker that sorts large numbers of transparent triangles. it waits for a sort to be pending, and
+	// clears the flag once it's done
+	std::thread					m_sortThread;
+	std::mutex					m_sortMutex;
+	std::condition_variable		m_sortCondition;
+	bool						m_sortPending;
+	bool						m_sortQuit;
+	float						m_sortRow[4];
+	GizmoTri*					m_sortOutput;
+
+	unsigned int	m_maxCapacity;
+	bool			m_shrink;
+	unsigned int	m_shrinkFrames;
 
 	// line data
-	unsigned int	m_maxLines;
 	unsigned int	m_lineCount;
 	GizmoLine*		m_lines;
 
-	unsigned int	m_lineVAO;
-	unsigned int 	m_lineVBO;
-
 	// triangle data
-	unsigned int	m_maxTris;
 	unsigned int	m_triCount;
 	GizmoTri*		m_tris;
-
-	unsigned int	m_triVAO;
-	unsigned int 	m_triVBO;
 	
 	unsigned int	m_transparentTriCount;
 	GizmoTri*		m_transparentTris;
-
-	unsigned int	m_transparentTriVAO;
-	unsigned int 	m_transparentTriVBO;
 	
 	// 2D line data
-	unsigned int	m_max2DLines;
 	unsigned int	m_2DlineCount;
-	GizmoLine*		m_2Dlines;
-
-	unsigned int	m_2DlineVAO;
-	unsigned int 	m_2DlineVBO;
+	Gizmo2DLine*	m_2Dlines;
 
 	// 2D triangle data
-	unsigned int	m_max2DTris;
 	unsigned int	m_2DtriCount;
-	GizmoTri*		m_2Dtris;
+	Gizmo2DTri*		m_2Dtris;
+
+	// 2D instanced circle data
+	unsigned int	m_circleShader;
+	int				m_circleProjectionViewUniform;
 
-	unsigned int	m_2DtriVAO;
-	unsigned int 	m_2DtriVBO;
+	unsigned int	m_2DcircleCount;
+	GizmoCircle*	m_2Dcircles;
 
 	static Gizmos*	sm_singleton;
 };
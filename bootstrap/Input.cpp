@@ -1,10 +1,44 @@
 #include "Input.h"
 #include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <string.h>
 
 namespace aie {
 
 Input* Input::m_instance = nullptr;
 
+// layout of a recorded input file. the file header is followed by one frame header per
+// frame, each followed by the events that changed during that frame
+static const unsigned int INPUT_RECORD_MAGIC = 0x49454941; // "AIEI"
+static const unsigned int INPUT_RECORD_VERSION = 1;
+
+struct InputRecordHeader {
+	unsigned int magic;
+	unsigned int version;
+};
+
+struct InputFrameHeader {
+	float				deltaTime;
+	unsigned int		eventCount;
+	unsigned long long	stepIndex;
+};
+
+enum InputEventType : unsigned char {
+	INPUT_EVENT_KEY,
+	INPUT_EVENT_MOUSE_BUTTON,
+	INPUT_EVENT_MOUSE_X,
+	INPUT_EVENT_MOUSE_Y,
+	INPUT_EVENT_SCROLL,
+	INPUT_EVENT_CHARACTER,
+};
+
+struct InputEvent {
+	unsigned char	type;
+	unsigned char	padding;
+	unsigned short	code;	// key or button
+	int				value;	// new state, position, character, or scroll delta as float bits
+};
+
 Input::Input() {
 
 	// track current/previous key and mouse button states
@@ -28,7 +62,9 @@ Input::Input() {
 
 	auto CharacterInputCallback = [](GLFWwindow* window, unsigned int character) {
 
-		Input::getInstance()->m_pressedCharacters.push_back(character);
+		// live input is ignored while replaying
+		if (!Input::getInstance()->isReplaying())
+			Input::getInstance()->m_pressedCharacters.push_back(character);
 
 		for (auto& f : Input::getInstance()->m_charCallbacks)
 			f(window, character);
@@ -38,7 +74,8 @@ Input::Input() {
 		int w = 0, h = 0;
 		glfwGetWindowSize(window, &w, &h);
 
-		Input::getInstance()->onMouseMove((int)x, h - (int)y);
+		if (!Input::getInstance()->isReplaying())
+			Input::getInstance()->onMouseMove((int)x, h - (int)y);
 
 		for (auto& f : Input::getInstance()->m_mouseMoveCallbacks)
 			f(window, x, h - y);
@@ -52,7 +89,8 @@ Input::Input() {
 
 	auto MouseScrollCallback = [](GLFWwindow* window, double xoffset, double yoffset) {
 
-		Input::getInstance()->m_mouseScroll += yoffset;
+		if (!Input::getInstance()->isReplaying())
+			Input::getInstance()->m_mouseScroll += yoffset;
 
 		for (auto& f : Input::getInstance()->m_mouseScrollCallbacks)
 			f(window, xoffset, yoffset);
@@ -73,9 +111,16 @@ Input::Input() {
 	m_mouseX = 0;
 	m_mouseY = 0;
 	m_mouseScroll = 0;
+
+	m_recordMode = RecordMode::None;
+	m_recordFile = nullptr;
+	m_replayOffset = 0;
+	m_stepIndex = 0;
+	m_replayStepIndex = 0;
 }
 
 Input::~Input() {
+	stopRecording();
 	delete[] m_lastKeys;
 	delete[] m_currentKeys;
 }
@@ -95,6 +140,17 @@ void Input::clearStatus() {
 
 	m_pressedCharacters.clear();
 
+	// while replaying the current state only changes when the next frame is applied
+	if (m_recordMode == RecordMode::Replay) {
+		for (int i = GLFW_KEY_SPACE; i <= GLFW_KEY_LAST; ++i)
+			m_lastKeys[i] = m_currentKeys[i];
+		for (int i = 0; i < 8; ++i)
+			m_lastButtons[i] = m_currentButtons[i];
+		m_oldMouseX = m_mouseX;
+		m_oldMouseY = m_mouseY;
+		return;
+	}
+
 	auto window = glfwGetCurrentContext();
 
 	m_pressedKeys.clear();
@@ -196,4 +252,215 @@ void Input::getMouseDelta(int * x, int * y)
 	if (y != nullptr) *y = m_mouseY - m_oldMouseY;
 }
 
+bool Input::startRecording(const char* filename) {
+
+	stopRecording();
+	stopReplay();
+
+	fopen_s(&m_recordFile, filename, "wb");
+	if (m_recordFile == nullptr)
+		return false;
+
+	InputRecordHeader header = { INPUT_RECORD_MAGIC, INPUT_RECORD_VERSION };
+	fwrite(&header, sizeof(header), 1, m_recordFile);
+
+	// the first recorded frame stores every key and button that is already down
+	m_recordedKeys.assign(GLFW_KEY_LAST + 1, GLFW_RELEASE);
+	for (int i = 0; i < 8; ++i)
+		m_recordedButtons[i] = GLFW_RELEASE;
+	m_recordedMouseX = m_recordedMouseY = -1;
+	m_recordedScroll = m_mouseScroll;
+
+	m_recordMode = RecordMode::Record;
+	return true;
+}
+
+void Input::stopRecording() {
+
+	if (m_recordMode != RecordMode::Record)
+		return;
+
+	fclose(m_recordFile);
+	m_recordFile = nullptr;
+
+	m_recordData.clear();
+	m_recordMode = RecordMode::None;
+}
+
+void Input::recordFrame(float deltaTime) {
+
+	if (m_recordMode != RecordMode::Record)
+		return;
+
+	// the frame header goes first and its event count is filled in once the events are known
+	InputFrameHeader frame = { deltaTime, 0, m_stepIndex };
+	m_recordData.resize(sizeof(InputFrameHeader));
+
+	auto addEvent = [this, &frame](InputEventType type, int code, int value) {
+		InputEvent e = { (unsigned char)type, 0, (unsigned short)code, value };
+		m_recordData.insert(m_recordData.end(), (char*)&e, (char*)&e + sizeof(e));
+		frame.eventCount++;
+	};
+
+	for (int i = GLFW_KEY_SPACE; i <= GLFW_KEY_LAST; ++i) {
+		if (m_currentKeys[i] != m_recordedKeys[i]) {
+			addEvent(INPUT_EVENT_KEY, i, m_currentKeys[i]);
+			m_recordedKeys[i] = m_currentKeys[i];
+		}
+	}
+
+	for (int i = 0; i < 8; ++i) {
+		if (m_currentButtons[i] != m_recordedButtons[i]) {
+			addEvent(INPUT_EVENT_MOUSE_BUTTON, i, m_currentButtons[i]);
+			m_recordedButtons[i] = m_currentButtons[i];
+		}
+	}
+
+	if (m_mouseX != m_recordedMouseX) {
+		addEvent(INPUT_EVENT_MOUSE_X, 0, m_mouseX);
+		m_recordedMouseX = m_mouseX;
+	}
+	if (m_mouseY != m_recordedMouseY) {
+		addEvent(INPUT_EVENT_MOUSE_Y, 0, m_mouseY);
+		m_recordedMouseY = m_mouseY;
+	}
+
+	if (m_mouseScroll != m_recordedScroll) {
+		float delta = (float)(m_mouseScroll - m_recordedScroll);
+		int bits;
+		memcpy(&bits, &delta, sizeof(bits));
+		addEvent(INPUT_EVENT_SCROLL, 0, bits);
+		m_recordedScroll += delta;
+	}
+
+	for (auto character : m_pressedCharacters)
+		addEvent(INPUT_EVENT_CHARACTER, 0, (int)character);
+
+	memcpy(m_recordData.data(), &frame, sizeof(frame));
+
+	// flushing every frame keeps the file whole up to the last frame if the application crashes
+	if (fwrite(m_recordData.data(), 1, m_recordData.size(), m_recordFile) != m_recordData.size() ||
+		fflush(m_recordFile) != 0) {
+		printf("Error: Failed to write input recording, recording stopped\n");
+		stopRecording();
+	}
+}
+
+bool Input::startReplay(const char* filename) {
+
+	stopRecording();
+	stopReplay();
+
+	FILE* file = nullptr;
+	fopen_s(&file, filename, "rb");
+	if (file == nullptr)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	m_recordData.resize(size > 0 ? size : 0);
+	size_t read = fread(m_recordData.data(), 1, m_recordData.size(), file);
+	fclose(file);
+
+	InputRecordHeader header = {};
+	if (read != m_recordData.size() || read < sizeof(header)) {
+		m_recordData.clear();
+		return false;
+	}
+
+	memcpy(&header, m_recordData.data(), sizeof(header));
+	if (header.magic != INPUT_RECORD_MAGIC || header.version != INPUT_RECORD_VERSION) {
+		m_recordData.clear();
+		return false;
+	}
+
+	// replays start from nothing held down, the same as when the recording started
+	for (int i = GLFW_KEY_SPACE; i <= GLFW_KEY_LAST; ++i)
+		m_lastKeys[i] = m_currentKeys[i] = GLFW_RELEASE;
+	for (int i = 0; i < 8; ++i)
+		m_lastButtons[i] = m_currentButtons[i] = GLFW_RELEASE;
+	m_pressedKeys.clear();
+	m_pressedCharacters.clear();
+
+	m_replayOffset = sizeof(header);
+	m_replayStepIndex = 0;
+	m_recordMode = RecordMode::Replay;
+	return true;
+}
+
+void Input::stopReplay() {
+
+	if (m_recordMode != RecordMode::Replay)
+		return;
+
+	m_recordData.clear();
+	m_replayOffset = 0;
+	m_recordMode = RecordMode::None;
+
+	// pick up the live mouse position again on its next move
+	m_firstMouseMove = true;
+}
+
+bool Input::replayFrame(float& deltaTime) {
+
+	if (m_recordMode != RecordMode::Replay)
+		return false;
+
+	InputFrameHeader frame;
+	if (m_replayOffset + sizeof(frame) > m_recordData.size()) {
+		stopReplay();
+		return false;
+	}
+	memcpy(&frame, m_recordData.data() + m_replayOffset, sizeof(frame));
+	m_replayOffset += sizeof(frame);
+
+	if (m_replayOffset + (size_t)frame.eventCount * sizeof(InputEvent) > m_recordData.size()) {
+		stopReplay();
+		return false;
+	}
+
+	for (unsigned int i = 0; i < frame.eventCount; ++i) {
+
+		InputEvent e;
+		memcpy(&e, m_recordData.data() + m_replayOffset, sizeof(e));
+		m_replayOffset += sizeof(e);
+
+		switch (e.type) {
+		case INPUT_EVENT_KEY:
+			if (e.code >= GLFW_KEY_SPACE && e.code <= GLFW_KEY_LAST)
+				m_currentKeys[e.code] = e.value;
+			break;
+		case INPUT_EVENT_MOUSE_BUTTON:
+			if (e.code < 8)
+				m_currentButtons[e.code] = e.value;
+			break;
+		case INPUT_EVENT_MOUSE_X:	m_mouseX = e.value;	break;
+		case INPUT_EVENT_MOUSE_Y:	m_mouseY = e.value;	break;
+		case INPUT_EVENT_SCROLL: {
+			float delta;
+			memcpy(&delta, &e.value, sizeof(delta));
+			m_mouseScroll += delta;
+			break;
+		}
+		case INPUT_EVENT_CHARACTER:
+			m_pressedCharacters.push_back((unsigned int)e.value);
+			break;
+		default:
+			break;
+		}
+	}
+
+	m_pressedKeys.clear();
+	for (int i = GLFW_KEY_SPACE; i <= GLFW_KEY_LAST; ++i) {
+		if (m_currentKeys[i] == GLFW_PRESS)
+			m_pressedKeys.push_back(m_currentKeys[i]);
+	}
+
+	deltaTime = frame.deltaTime;
+	m_replayStepIndex = frame.stepIndex;
+	return true;
+}
+
 } // namespace aie
\ No newline at end of file
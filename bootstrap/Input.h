@@ -3,6 +3,7 @@
 #include <vector>
 #include <functional>
 #include <map>
+#include <cstdio>
 
 struct GLFWwindow;
 
@@ -190,6 +191,23 @@ public:
 	void attachMouseMoveObserver(const MouseMoveCallback& callback) { m_mouseMoveCallbacks.push_back(callback); }
 	void attachMouseScrollObserver(const MouseScrollCallback& callback) { m_mouseScrollCallbacks.push_back(callback); }
 
+	// records every change in key, mouse and character input each frame, along with the frame's delta time,
+	// to a compact binary file. each frame is written and flushed as it's recorded, so a crash only loses that frame
+	bool startRecording(const char* filename);
+	void stopRecording();
+	bool isRecording() const { return m_recordMode == RecordMode::Record; }
+
+	// replays a recorded file frame by frame in place of the keyboard and mouse. the application
+	// uses the recorded delta time for each frame, so a replay can run faster than real time
+	bool startReplay(const char* filename);
+	void stopReplay();
+	bool isReplaying() const { return m_recordMode == RecordMode::Replay; }
+
+	// an index supplied by the application (such as a fixed simulation step) that is recorded with each frame.
+	// while replaying, getReplayStepIndex() returns the index that was recorded for the current frame
+	void setStepIndex(unsigned long long stepIndex) { m_stepIndex = stepIndex; }
+	unsigned long long getReplayStepIndex() const { return m_replayStepIndex; }
+
 protected:
 
 	// just giving the Application class access to the Input singleton
@@ -206,6 +224,12 @@ protected:
 	// or before glfwPollEvents
 	void clearStatus();
 
+	// called by the application once events have been polled, before update. recordFrame() stores
+	// the changes made this frame, and replayFrame() applies the next recorded frame and replaces
+	// deltaTime with the recorded value. replayFrame() returns false once the replay has finished
+	void recordFrame(float deltaTime);
+	bool replayFrame(float& deltaTime);
+
 private:
 
 	// constructor private for singleton
@@ -234,6 +258,23 @@ private:
 	// used to track down/up/released/pressed
 	int* m_lastKeys, *m_currentKeys;
 	int m_lastButtons[8], m_currentButtons[8];
+
+	// input recording and replay
+	enum class RecordMode { None, Record, Replay };
+
+	RecordMode			m_recordMode;
+	FILE*				m_recordFile;
+	std::vector<char>	m_recordData;	// the frame being recorded, or the whole file being replayed
+	size_t				m_replayOffset;
+
+	unsigned long long	m_stepIndex;
+	unsigned long long	m_replayStepIndex;
+
+	// the state as of the last recorded frame, so that only changes are recorded
+	std::vector<int>	m_recordedKeys;
+	int					m_recordedButtons[8];
+	int					m_recordedMouseX, m_recordedMouseY;
+	double				m_recordedScroll;
 };
 
 } // namespace aie
\ No newline at end of file
@@ -3,12 +3,17 @@
 #include "Renderer2D.h"
 #include "Texture.h"
 #include "Font.h"
+#include "GLState.h"
+#include "AssetCache.h"
+#include "StreamBuffer.h"
+#include "TextureAtlas.h"
+#include "TextureManager.h"
+#include "StaticText.h"
 #include <glm/ext.hpp>
-#include <stb_truetype.h>
 
 namespace aie {
 
-Renderer2D::Renderer2D() {
+Renderer2D::Renderer2D(unsigned int batchSize) {
 
 	setRenderColour(1,1,1,1);
 	setUVRect(0.0f, 0.0f, 1.0f, 1.0f);
@@ -21,25 +26,31 @@ Renderer2D::Renderer2D() {
 
 	m_currentVertex = 0;
 	m_currentIndex = 0;
+	m_batchVertex = 0;
+	m_batchIndex = 0;
 	m_renderBegun = false;
 
+	// room for at least one shape
+	m_maxVertices = glm::max(batchSize * 4, 4u);
+	m_maxIndices = glm::max(batchSize * 6, 6u);
+
 	m_vao = -1;
-	m_vbo = -1;
-	m_ibo = -1;
 
 	m_currentTexture = 0;
+	m_atlas = nullptr;
+	m_deferred = false;
 
 	for (int i = 0; i < TEXTURE_STACK_SIZE; i++) {
-		m_textureStack[i] = nullptr;
+		m_textureStack[i] = 0;
 		m_fontTexture[i] = 0;
 	}
 
 	char* vertexShader = "#version 150\n \
 						in vec4 position; \
 						in vec4 colour; \
-						in vec2 texcoord; \
+						in vec3 texcoord; \
 						out vec4 vColour; \
-						out vec2 vTexCoord; \
+						out vec3 vTexCoord; \
 						out float vTextureID; \
 						uniform mat4 projectionMatrix; \
 						void main() { vColour = colour; vTexCoord = texcoord; vTextureID = position.w; \
@@ -47,121 +58,143 @@ Renderer2D::Renderer2D() {
 
 	char* fragmentShader = "#version 150\n \
 						in vec4 vColour; \
-						in vec2 vTexCoord; \
+						in vec3 vTexCoord; \
 						in float vTextureID; \
 						out vec4 fragColour; \
 						const int TEXTURE_STACK_SIZE = 16; \
 						uniform sampler2D textureStack[TEXTURE_STACK_SIZE]; \
 						uniform int isFontTexture[TEXTURE_STACK_SIZE]; \
+						uniform sampler2DArray atlas; \
 						void main() { \
 							int id = int(vTextureID); \
 							if (id < TEXTURE_STACK_SIZE) { \
-								vec4 rgba = texture2D(textureStack[id], vTexCoord); \
+								vec4 rgba = texture2D(textureStack[id], vTexCoord.xy); \
 								if (isFontTexture[id] == 1) \
 									rgba = rgba.rrrr; \
+								else if (isFontTexture[id] == 2) { \
+									float edge = fwidth(rgba.r) * 0.5f; \
+									rgba = vec4(smoothstep(0.5f - edge, 0.5f + edge, rgba.r)); \
+								} \
 								fragColour = rgba * vColour; \
+							} else if (id == TEXTURE_STACK_SIZE) \
+								fragColour = texture(atlas, vTexCoord) * vColour; \
+							else if (id == TEXTURE_STACK_SIZE + 1) { \
+								float d = length(vTexCoord.xy); \
+								float coverage = clamp((1.0f - d) / fwidth(d) + 0.5f, 0.0f, 1.0f); \
+								if (vTexCoord.z > 0.0f) \
+									coverage *= clamp((d - vTexCoord.z) / fwidth(d) + 0.5f, 0.0f, 1.0f); \
+								fragColour = vec4(vColour.rgb, vColour.a * coverage); \
+							} else if (id == TEXTURE_STACK_SIZE + 2) { \
+								vec2 d = 1.0f - abs(vTexCoord.xy); \
+								vec2 coverage = clamp(d / fwidth(vTexCoord.xy) + 0.5f, 0.0f, 1.0f); \
+								fragColour = vec4(vColour.rgb, vColour.a * coverage.x * coverage.y); \
 							} else fragColour = vColour; \
 						if (fragColour.a < 0.001f) discard; }";
 	
-	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
-	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
-
-	glShaderSource(vs, 1, (const char**)&vertexShader, 0);
-	glCompileShader(vs);
-
-	glShaderSource(fs, 1, (const char**)&fragmentShader, 0);
-	glCompileShader(fs);
-
-	m_shader = glCreateProgram();
-	glAttachShader(m_shader, vs);
-	glAttachShader(m_shader, fs);
-	glBindAttribLocation(m_shader, 0, "position");
-	glBindAttribLocation(m_shader, 1, "colour");
-	glBindAttribLocation(m_shader, 2, "texcoord");
-	glLinkProgram(m_shader);
-
-	int success = GL_FALSE;
-	glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		int infoLogLength = 0;
-		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-		char* infoLog = new char[infoLogLength];
-
-		glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
-		printf("Error: Failed to link SpriteBatch shader program!\n%s\n", infoLog);
-		delete[] infoLog;
+	// a program linked on an earlier run is loaded from the asset cache instead of compiled
+	unsigned long long key = AssetCache::hash(vertexShader);
+	key = AssetCache::hash(fragmentShader, key);
+	m_shader = AssetCache::loadProgram(key);
+
+	if (m_shader == 0) {
+		unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
+		unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
+
+		glShaderSource(vs, 1, (const char**)&vertexShader, 0);
+		glCompileShader(vs);
+
+		glShaderSource(fs, 1, (const char**)&fragmentShader, 0);
+		glCompileShader(fs);
+
+		m_shader = glCreateProgram();
+		glAttachShader(m_shader, vs);
+		glAttachShader(m_shader, fs);
+		glBindAttribLocation(m_shader, 0, "position");
+		glBindAttribLocation(m_shader, 1, "colour");
+		glBindAttribLocation(m_shader, 2, "texcoord");
+		AssetCache::prepareProgram(m_shader);
+		glLinkProgram(m_shader);
+
+		int success = GL_FALSE;
+		glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
+		if (success == GL_FALSE) {
+			int infoLogLength = 0;
+			glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+			char* infoLog = new char[infoLogLength];
+
+			glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
+			printf("Error: Failed to link SpriteBatch shader program!\n%s\n", infoLog);
+			delete[] infoLog;
+		}
+		else
+			AssetCache::storeProgram(key, m_shader);
+
+		glDeleteShader(vs);
+		glDeleteShader(fs);
 	}
 
-	glUseProgram(m_shader);
+	GLState::useProgram(m_shader);
 
-	// set texture locations
-	char buf[32];
-	for (int i = 0; i < TEXTURE_STACK_SIZE; ++i) {
-		sprintf_s(buf, "textureStack[%i]", i);
-		glUniform1i(glGetUniformLocation(m_shader, buf), i);
-	}
+	// set texture locations, each texture in the stack is bound to the unit of the same index
+	int textureUnits[TEXTURE_STACK_SIZE];
+	for (int i = 0; i < TEXTURE_STACK_SIZE; ++i)
+		textureUnits[i] = i;
+	glUniform1iv(glGetUniformLocation(m_shader, "textureStack"), TEXTURE_STACK_SIZE, textureUnits);
+	glUniform1i(glGetUniformLocation(m_shader, "atlas"), ATLAS_TEXTURE_UNIT);
 
-	glUseProgram(0);
+	// the other uniforms are set every frame or batch, so find them once
+	m_projectionMatrixUniform = glGetUniformLocation(m_shader, "projectionMatrix");
+	m_isFontTextureUniform = glGetUniformLocation(m_shader, "isFontTexture");
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+	GLState::useProgram(0);
 	
-	// pre calculate the indices... they will always be the same
-	int index = 0;
-	for (int i = 0; i<(MAX_SPRITES*6);) {
-		m_indices[i++] = (index + 0);
-		m_indices[i++] = (index + 1);
-		m_indices[i++] = (index + 2);
-
-		m_indices[i++] = (index + 0);
-		m_indices[i++] = (index + 2);
-		m_indices[i++] = (index + 3);
-		index += 4;
-	}
+	// vertices and indices are written straight into the current section of a ring of stream buffer sections,
+	// one batch in size. a batch continues on from the last one in the same section until the section is full
+	m_vertexStream = new StreamBuffer(m_maxVertices * sizeof(SBVertex));
+	m_indexStream = new StreamBuffer(m_maxIndices * sizeof(unsigned int));
+	m_vertices = (SBVertex*)m_vertexStream->getWritePointer();
+	m_indices = (unsigned int*)m_indexStream->getWritePointer();
 	
-	// create the vao, vio and vbo
+	// create the vao
 	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
-	glGenBuffers(1, &m_vbo);
-	glGenBuffers(1, &m_ibo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (MAX_SPRITES * 6) * sizeof(unsigned short), (void *)(&m_indices[0]), GL_STATIC_DRAW);
-	glBufferData(GL_ARRAY_BUFFER, (MAX_SPRITES * 4) * sizeof(SBVertex), m_vertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)16);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)32);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(m_vao);
+	GLState::bindArrayBuffer(m_vertexStream->getBuffer());
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexStream->getBuffer());
+	setVertexAttributes();
+	GLState::bindVertexArray(0);
 }
 
 Renderer2D::~Renderer2D() {
-	glDeleteBuffers(1, &m_vbo);
-	glDeleteBuffers(1, &m_ibo);
-	glDeleteBuffers(1, &m_vao);
-	glDeleteProgram(m_shader);
+	delete m_vertexStream;
+	delete m_indexStream;
+	GLState::deleteVertexArrays(1, &m_vao);
+	GLState::deletePrograms(1, &m_shader);
 	delete m_nullTexture;
 }
 
 void Renderer2D::begin() {
 	m_renderBegun = true;
-	m_currentIndex = 0;
-	m_currentVertex = 0;
+	m_commands.clear();
+	m_sortItems.clear();
+	m_staticTexts.clear();
+	m_batchVertex = m_currentVertex;
+	m_batchIndex = m_currentIndex;
 	m_currentTexture = 0;
 
 	int width = 0, height = 0;
 	auto window = glfwGetCurrentContext();
 	glfwGetWindowSize(window, &width, &height);
 	
-	glUseProgram(m_shader);
+	GLState::useProgram(m_shader);
 
 	auto projection = glm::ortho(m_cameraX, m_cameraX + (float)width, m_cameraY, m_cameraY + (float)height, 1.0f, -101.0f);
-	glUniformMatrix4fv(glGetUniformLocation(m_shader, "projectionMatrix"), 1, false, &projection[0][0]);
+	glUniformMatrix4fv(m_projectionMatrixUniform, 1, false, &projection[0][0]);
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::setBlend(true);
+	GLState::setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	if (m_atlas != nullptr)
+		GLState::bindTextureArray(m_atlas->getHandle(), ATLAS_TEXTURE_UNIT);
 
 	setRenderColour(1,1,1,1);
 }
@@ -170,9 +203,12 @@ void Renderer2D::end() {
 	if (m_renderBegun == false)
 		return;
 
+	if (m_deferred)
+		drawCommands();
+
 	flushBatch();
 
-	glUseProgram(0);
+	GLState::useProgram(0);
 
 	m_renderBegun = false;
 }
@@ -182,57 +218,23 @@ void Renderer2D::drawBox(float xPos, float yPos, float width, float height, floa
 }
 
 void Renderer2D::drawCircle(float xPos, float yPos, float radius, float depth) {
+	drawRing(xPos, yPos, 0.0f, radius, depth);
+}
 
-	if (shouldFlush(33,96))
-		flushBatch();
-	unsigned int textureID = pushTexture(m_nullTexture);
-
-	int startIndex = m_currentVertex;
-
-	// centre vertex
-	m_vertices[m_currentVertex].pos[0] = xPos;
-	m_vertices[m_currentVertex].pos[1] = yPos;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = 0;
-	m_vertices[m_currentVertex].texcoord[1] = 0;
-	m_currentVertex++;
-
-	float rotDelta = glm::pi<float>() * 2 / 32;
-
-	// 32 segment sphere
-	for (int i = 0; i < 32; ++i) {
-
-		if (shouldFlush())
-			flushBatch();
-
-		m_vertices[m_currentVertex].pos[0] = glm::sin(rotDelta * i) * radius + xPos;
-		m_vertices[m_currentVertex].pos[1] = glm::cos(rotDelta * i) * radius + yPos;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)textureID;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = 0.5f;
-		m_vertices[m_currentVertex].texcoord[1] = 0.5f;
-		m_currentVertex++;
-
-		if (i == (32-1)) {
-			m_indices[m_currentIndex++] = startIndex;
-			m_indices[m_currentIndex++] = startIndex + 1;
-			m_indices[m_currentIndex++] = m_currentVertex - 1;
-		}
-		else {
-			m_indices[m_currentIndex++] = startIndex;
-			m_indices[m_currentIndex++] = m_currentVertex;
-			m_indices[m_currentIndex++] = m_currentVertex - 1;
-		}
-	}
+void Renderer2D::drawRing(float xPos, float yPos, float innerRadius, float outerRadius, float depth) {
+
+	if (outerRadius <= 0.0f ||
+		innerRadius >= outerRadius)
+		return;
+
+	Shape shape;
+	initShape(shape, SHAPE_CIRCLE, nullptr, depth);
+	shape.x[0] = xPos;
+	shape.y[0] = yPos;
+	shape.x[1] = outerRadius;
+	shape.x[2] = glm::max(innerRadius, 0.0f);
+
+	submitShape(shape);
 }
 
 void Renderer2D::drawSprite(Texture * texture,
@@ -242,10 +244,6 @@ void Renderer2D::drawSprite(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
-	unsigned int textureID = pushTexture(texture);
-
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
 	if (height == 0.0f)
@@ -264,63 +262,14 @@ void Renderer2D::drawSprite(Texture * texture,
 		rotateAround(blX, blY, blX, blY, si, co);
 	}
 
-	int index = m_currentVertex;
-
-	m_vertices[m_currentVertex].pos[0] = xPos + tlX;
-	m_vertices[m_currentVertex].pos[1] = yPos + tlY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = xPos + trX;
-	m_vertices[m_currentVertex].pos[1] = yPos + trY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = xPos + brX;
-	m_vertices[m_currentVertex].pos[1] = yPos + brY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = xPos + blX;
-	m_vertices[m_currentVertex].pos[1] = yPos + blY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
+	Shape shape;
+	initShape(shape, SHAPE_QUAD, texture, depth);
+	shape.x[0] = xPos + tlX;	shape.y[0] = yPos + tlY;
+	shape.x[1] = xPos + trX;	shape.y[1] = yPos + trY;
+	shape.x[2] = xPos + brX;	shape.y[2] = yPos + brY;
+	shape.x[3] = xPos + blX;	shape.y[3] = yPos + blY;
 
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
+	submitShape(shape);
 }
 
 void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
@@ -330,11 +279,6 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
-
-	unsigned int textureID = pushTexture(texture);
-
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
 	if (height == 0.0f)
@@ -349,77 +293,18 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	// 0 3 6
 	// 1 4 7
 	// 2 5 8
-	float x, y;
-	x = tlX; y = tlY;
-	tlX = x * transformMat3x3[0] + y * transformMat3x3[3] + transformMat3x3[6];
-	tlY = x * transformMat3x3[1] + y * transformMat3x3[4] + transformMat3x3[7];
-	x = trX; y = trY;
-	trX = x * transformMat3x3[0] + y * transformMat3x3[3] + transformMat3x3[6];
-	trY = x * transformMat3x3[1] + y * transformMat3x3[4] + transformMat3x3[7];
-	x = brX; y = brY;
-	brX = x * transformMat3x3[0] + y * transformMat3x3[3] + transformMat3x3[6];
-	brY = x * transformMat3x3[1] + y * transformMat3x3[4] + transformMat3x3[7];
-	x = blX; y = blY;
-	blX = x * transformMat3x3[0] + y * transformMat3x3[3] + transformMat3x3[6];
-	blY = x * transformMat3x3[1] + y * transformMat3x3[4] + transformMat3x3[7];	
-
-	int index = m_currentVertex;
-	
-	m_vertices[m_currentVertex].pos[0] = tlX;
-	m_vertices[m_currentVertex].pos[1] = tlY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = trX;
-	m_vertices[m_currentVertex].pos[1] = trY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = brX;
-	m_vertices[m_currentVertex].pos[1] = brY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = blX;
-	m_vertices[m_currentVertex].pos[1] = blY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
+	Shape shape;
+	initShape(shape, SHAPE_QUAD, texture, depth);
+	shape.x[0] = tlX * transformMat3x3[0] + tlY * transformMat3x3[3] + transformMat3x3[6];
+	shape.y[0] = tlX * transformMat3x3[1] + tlY * transformMat3x3[4] + transformMat3x3[7];
+	shape.x[1] = trX * transformMat3x3[0] + trY * transformMat3x3[3] + transformMat3x3[6];
+	shape.y[1] = trX * transformMat3x3[1] + trY * transformMat3x3[4] + transformMat3x3[7];
+	shape.x[2] = brX * transformMat3x3[0] + brY * transformMat3x3[3] + transformMat3x3[6];
+	shape.y[2] = brX * transformMat3x3[1] + brY * transformMat3x3[4] + transformMat3x3[7];
+	shape.x[3] = blX * transformMat3x3[0] + blY * transformMat3x3[3] + transformMat3x3[6];
+	shape.y[3] = blX * transformMat3x3[1] + blY * transformMat3x3[4] + transformMat3x3[7];
+
+	submitShape(shape);
 }
 
 void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
@@ -429,10 +314,6 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
-	unsigned int textureID = pushTexture(texture);
-
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
 	if (height == 0.0f)
@@ -448,246 +329,419 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	// 1 5 9  13
 	// 2 6 10 14
 	// 3 7 11 15
-	float x, y;
-	x = tlX; y = tlY;
-	tlX = x * transformMat4x4[0] + y * transformMat4x4[4] + transformMat4x4[12];
-	tlY = x * transformMat4x4[1] + y * transformMat4x4[5] + transformMat4x4[13];
-	x = trX; y = trY;
-	trX = x * transformMat4x4[0] + y * transformMat4x4[4] + transformMat4x4[12];
-	trY = x * transformMat4x4[1] + y * transformMat4x4[5] + transformMat4x4[13];
-	x = brX; y = brY;
-	brX = x * transformMat4x4[0] + y * transformMat4x4[4] + transformMat4x4[12];
-	brY = x * transformMat4x4[1] + y * transformMat4x4[5] + transformMat4x4[13];
-	x = blX; y = blY;
-	blX = x * transformMat4x4[0] + y * transformMat4x4[4] + transformMat4x4[12];
-	blY = x * transformMat4x4[1] + y * transformMat4x4[5] + transformMat4x4[13];
+	Shape shape;
+	initShape(shape, SHAPE_QUAD, texture, depth);
+	shape.x[0] = tlX * transformMat4x4[0] + tlY * transformMat4x4[4] + transformMat4x4[12];
+	shape.y[0] = tlX * transformMat4x4[1] + tlY * transformMat4x4[5] + transformMat4x4[13];
+	shape.x[1] = trX * transformMat4x4[0] + trY * transformMat4x4[4] + transformMat4x4[12];
+	shape.y[1] = trX * transformMat4x4[1] + trY * transformMat4x4[5] + transformMat4x4[13];
+	shape.x[2] = brX * transformMat4x4[0] + brY * transformMat4x4[4] + transformMat4x4[12];
+	shape.y[2] = brX * transformMat4x4[1] + brY * transformMat4x4[5] + transformMat4x4[13];
+	shape.x[3] = blX * transformMat4x4[0] + blY * transformMat4x4[4] + transformMat4x4[12];
+	shape.y[3] = blX * transformMat4x4[1] + blY * transformMat4x4[5] + transformMat4x4[13];
+
+	submitShape(shape);
+}
 
-	int index = m_currentVertex;
+void Renderer2D::drawLine(float x1, float y1, float x2, float y2, float thickness, float depth) {
 
-	m_vertices[m_currentVertex].pos[0] = tlX;
-	m_vertices[m_currentVertex].pos[1] = tlY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = trX;
-	m_vertices[m_currentVertex].pos[1] = trY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = brX;
-	m_vertices[m_currentVertex].pos[1] = brY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-
-	m_vertices[m_currentVertex].pos[0] = blX;
-	m_vertices[m_currentVertex].pos[1] = blY;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
-	m_currentVertex++;
-	
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
+	if (thickness <= 0.0f ||
+		(x1 == x2 && y1 == y2))
+		return;
 
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
+	Shape shape;
+	initShape(shape, SHAPE_LINE, nullptr, depth);
+	shape.x[0] = x1;
+	shape.y[0] = y1;
+	shape.x[1] = x2;
+	shape.y[1] = y2;
+	shape.x[2] = thickness;
+
+	submitShape(shape);
 }
 
-void Renderer2D::drawLine(float x1, float y1, float x2, float y2, float thickness, float depth) {
+void Renderer2D::drawText(Font * font, const char* text, float xPos, float yPos, float depth) {
 
-	float xDiff = x2 - x1;
-	float yDiff = y2 - y1;
-	float len = glm::sqrt(xDiff * xDiff + yDiff * yDiff);
-	float xDir = xDiff / len;
-	float yDir = yDiff / len;
+	if (font == nullptr ||
+		font->m_glHandle == 0)
+		return;
 
-	float rot = glm::atan(yDir, xDir);
+	drawText(font->getLayout(text), xPos, yPos, depth);
+}
 
-	float uvX = m_uvX;
-	float uvY = m_uvY;
-	float uvW = m_uvW;
-	float uvH = m_uvH;
+void Renderer2D::drawText(const TextLayout& layout, float xPos, float yPos, float depth) {
 
-	setUVRect(0.0f, 0.0f, 1.0f, 1.0f);
+	Font* font = layout.getFont();
+	if (font == nullptr ||
+		font->m_glHandle == 0)
+		return;
+
+	Shape shape;
+	initShape(shape, SHAPE_QUAD, nullptr, depth);
+	shape.texture = font->getTextureHandle();
+	shape.font = font->isDistanceField() ? FONT_DISTANCE_FIELD : FONT_BITMAP;
+
+	// glyphs are laid out top to bottom, so we need to invert them
+	for (auto& glyph : layout.getGlyphs()) {
 
-	drawSprite(m_nullTexture, x1, y1, len, thickness, rot, depth, 0.0f, 0.5f);
+		shape.x[0] = xPos + glyph.x0;	shape.y[0] = yPos - glyph.y1;
+		shape.x[1] = xPos + glyph.x1;	shape.y[1] = yPos - glyph.y1;
+		shape.x[2] = xPos + glyph.x1;	shape.y[2] = yPos - glyph.y0;
+		shape.x[3] = xPos + glyph.x0;	shape.y[3] = yPos - glyph.y0;
+		shape.u0 = glyph.s0;	shape.v0 = glyph.t0;
+		shape.u1 = glyph.s1;	shape.v1 = glyph.t1;
 
-	setUVRect(uvX, uvY, uvW, uvH);
+		submitShape(shape);
+	}
 }
 
-void Renderer2D::drawText(Font * font, const char* text, float xPos, float yPos, float depth) {
+StaticText* Renderer2D::createStaticText(Font* font, const char* text, float xPos, float yPos, float depth) {
 
+	StaticText* staticText = new StaticText(font, text);
+	const TextLayout& layout = staticText->m_layout;
 	if (font == nullptr ||
-		font->m_glHandle == 0)
+		font->m_glHandle == 0 ||
+		layout.getGlyphs().empty())
+		return staticText;
+
+	// the glyphs are written as shapes would be, always sampling the font from the first texture unit
+	std::vector<SBVertex> vertices(layout.getGlyphs().size() * 4);
+	std::vector<unsigned int> indices;
+	indices.reserve(layout.getGlyphs().size() * 6);
+
+	Shape shape;
+	initShape(shape, SHAPE_QUAD, nullptr, depth);
+
+	unsigned int index = 0;
+	for (auto& glyph : layout.getGlyphs()) {
+		writeVertex(vertices[index + 0], shape, xPos + glyph.x0, yPos - glyph.y1, glyph.s0, glyph.t1, 0, 0);
+		writeVertex(vertices[index + 1], shape, xPos + glyph.x1, yPos - glyph.y1, glyph.s1, glyph.t1, 0, 0);
+		writeVertex(vertices[index + 2], shape, xPos + glyph.x1, yPos - glyph.y0, glyph.s1, glyph.t0, 0, 0);
+		writeVertex(vertices[index + 3], shape, xPos + glyph.x0, yPos - glyph.y0, glyph.s0, glyph.t0, 0, 0);
+
+		indices.push_back(index + 0);
+		indices.push_back(index + 2);
+		indices.push_back(index + 3);
+
+		indices.push_back(index + 0);
+		indices.push_back(index + 1);
+		indices.push_back(index + 2);
+		index += 4;
+	}
+
+	glGenVertexArrays(1, &staticText->m_vao);
+	glGenBuffers(1, &staticText->m_vbo);
+	glGenBuffers(1, &staticText->m_ibo);
+
+	GLState::bindVertexArray(staticText->m_vao);
+	GLState::bindArrayBuffer(staticText->m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SBVertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, staticText->m_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	setVertexAttributes();
+	GLState::bindVertexArray(0);
+
+	staticText->m_indexCount = (unsigned int)indices.size();
+	return staticText;
+}
+
+void Renderer2D::drawStaticText(StaticText* text) {
+
+	if (m_renderBegun == false ||
+		text == nullptr ||
+		text->m_indexCount == 0)
+		return;
+
+	// in deferred mode static text is drawn after the sorted shapes
+	if (m_deferred) {
+		m_staticTexts.push_back(text);
+		return;
+	}
+
+	// draw what has been batched so far first, which also leaves the texture stack empty for the font
+	flushBatch();
+
+	GLState::bindTexture(text->m_layout.getFont()->getTextureHandle(), 0);
+	m_fontTexture[0] = text->m_layout.getFont()->isDistanceField() ? FONT_DISTANCE_FIELD : FONT_BITMAP;
+	glUniform1iv(m_isFontTextureUniform, TEXTURE_STACK_SIZE, m_fontTexture);
+	m_fontTexture[0] = 0;
+
+	unsigned int depthFunc = GLState::get().depthFunc;
+	GLState::setDepthFunc(GL_LEQUAL);
+
+	GLState::bindVertexArray(text->m_vao);
+	glDrawElements(GL_TRIANGLES, text->m_indexCount, GL_UNSIGNED_INT, 0);
+
+	GLState::setDepthFunc(depthFunc);
+}
+
+void Renderer2D::initShape(Shape& shape, ShapeType type, Texture* texture, float depth) {
+
+	shape.type = type;
+	shape.font = FONT_NONE;
+	shape.atlas = false;
+	shape.depth = depth;
+	shape.colour[0] = m_r;
+	shape.colour[1] = m_g;
+	shape.colour[2] = m_b;
+	shape.colour[3] = m_a;
+	shape.u0 = m_uvX;
+	shape.v0 = m_uvY;
+	shape.u1 = m_uvX + m_uvW;
+	shape.v1 = m_uvY + m_uvH;
+	shape.layer = 0;
+	shape.texture = texture != nullptr ? texture->getHandle() : 0;
+
+	// textures in the atlas are drawn from their region of it, which doesn't use a place in the texture stack
+	const TextureAtlas::Region* region = m_atlas != nullptr && texture != nullptr ? m_atlas->find(texture) : nullptr;
+	if (region != nullptr) {
+		shape.atlas = true;
+		shape.texture = m_atlas->getHandle();
+		shape.u0 = region->uvX + m_uvX * region->uvW;
+		shape.v0 = region->uvY + m_uvY * region->uvH;
+		shape.u1 = shape.u0 + m_uvW * region->uvW;
+		shape.v1 = shape.v0 + m_uvH * region->uvH;
+		shape.layer = (float)region->layer;
+	}
+	else if (texture != nullptr) {
+
+		// a texture still loading, or evicted and loading again, draws as the plain white texture until it is ready
+		TextureManager::touch(texture);
+		if (texture->getHandle() == 0)
+			shape.texture = m_nullTexture->getHandle();
+	}
+}
+
+void Renderer2D::submitShape(const Shape& shape) {
+
+	if (m_deferred == false) {
+		writeShape(shape);
 		return;
+	}
+
+	// the key puts the farthest depth first, then groups shapes by font and texture within a depth.
+	// the command's index is below it, so sorting the keys also sorts the commands
+	float depth = glm::clamp(shape.depth, 0.0f, 100.0f);
+	unsigned long long depthKey = (unsigned long long)((100.0f - depth) * (65535.0f / 100.0f));
+	unsigned long long key = (depthKey << 48) |
+		((unsigned long long)(shape.font != FONT_NONE ? 1 : 0) << 47) |
+		((unsigned long long)(shape.texture & 0x7fff) << 32) |
+		(unsigned long long)m_commands.size();
+
+	m_commands.push_back(shape);
+	m_sortItems.push_back(key);
+}
 
-	stbtt_aligned_quad Q = {};
+void Renderer2D::writeShape(const Shape& shape) {
 
-	if (shouldFlush() || m_currentTexture >= TEXTURE_STACK_SIZE - 1)
+	if (shouldFlush(4, 6))
 		flushBatch();
 
-	glActiveTexture(GL_TEXTURE0 + m_currentTexture++);
-	glBindTexture(GL_TEXTURE_2D, font->getTextureHandle());
-	glActiveTexture(GL_TEXTURE0);
-	m_fontTexture[m_currentTexture - 1] = 1;
+	// pushing a texture can flush the batch, which starts it again from the first vertex, so the shape's
+	// texture is pushed before its first vertex is taken
+	float textureID;
+	if (shape.type == SHAPE_CIRCLE)
+		textureID = (float)CIRCLE_TEXTURE_ID;
+	else if (shape.type == SHAPE_LINE)
+		textureID = (float)LINE_TEXTURE_ID;
+	else
+		textureID = (float)(shape.atlas ? (unsigned int)ATLAS_TEXTURE_ID : pushTexture(shape.texture, shape.font));
+
+	int index = m_currentVertex;
 
-	// font renders top to bottom, so we need to invert it
-	int w = 0, h = 0;
-	glfwGetWindowSize(glfwGetCurrentContext(), &w, &h);
+	// circles and lines are quads a pixel larger than the shape, with coordinates that are 1 at its edges,
+	// so the shader can find the distance to them and antialias them without a texture
+	if (shape.type == SHAPE_CIRCLE) {
 
-	yPos = h - yPos;
+		float extent = shape.x[1] + 1;
+		float coord = extent / shape.x[1];
+		float inner = shape.x[2] / shape.x[1];
 
-	while (*text != 0) {
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[0] - extent, shape.y[0] - extent, -coord, -coord, inner, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[0] + extent, shape.y[0] - extent, coord, -coord, inner, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[0] + extent, shape.y[0] + extent, coord, coord, inner, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[0] - extent, shape.y[0] + extent, -coord, coord, inner, textureID);
+	}
+	else if (shape.type == SHAPE_LINE) {
+
+		float xDiff = shape.x[1] - shape.x[0];
+		float yDiff = shape.y[1] - shape.y[0];
+		float len = glm::sqrt(xDiff * xDiff + yDiff * yDiff);
+		float xDir = xDiff / len;
+		float yDir = yDiff / len;
+
+		float halfLength = len * 0.5f + 1;
+		float halfWidth = shape.x[2] * 0.5f + 1;
+		float lengthCoord = halfLength / (len * 0.5f);
+		float widthCoord = halfWidth / (shape.x[2] * 0.5f);
+
+		float centreX = (shape.x[0] + shape.x[1]) * 0.5f;
+		float centreY = (shape.y[0] + shape.y[1]) * 0.5f;
+		float alongX = xDir * halfLength;	float alongY = yDir * halfLength;
+		float acrossX = -yDir * halfWidth;	float acrossY = xDir * halfWidth;
+
+		writeVertex(m_vertices[m_currentVertex++], shape, centreX - alongX - acrossX, centreY - alongY - acrossY, -lengthCoord, -widthCoord, 0, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, centreX + alongX - acrossX, centreY + alongY - acrossY, lengthCoord, -widthCoord, 0, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, centreX + alongX + acrossX, centreY + alongY + acrossY, lengthCoord, widthCoord, 0, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, centreX - alongX + acrossX, centreY - alongY + acrossY, -lengthCoord, widthCoord, 0, textureID);
+	}
+	else {
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[0], shape.y[0], shape.u0, shape.v1, shape.layer, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[1], shape.y[1], shape.u1, shape.v1, shape.layer, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[2], shape.y[2], shape.u1, shape.v0, shape.layer, textureID);
+		writeVertex(m_vertices[m_currentVertex++], shape, shape.x[3], shape.y[3], shape.u0, shape.v0, shape.layer, textureID);
+	}
 
-		if (shouldFlush() || m_currentTexture >= TEXTURE_STACK_SIZE - 1) {
-				flushBatch();
+	m_indices[m_currentIndex++] = (index + 0);
+	m_indices[m_currentIndex++] = (index + 2);
+	m_indices[m_currentIndex++] = (index + 3);
 
-			glActiveTexture(GL_TEXTURE0 + m_currentTexture++);
-			glBindTexture(GL_TEXTURE_2D, font->getTextureHandle());
-			glActiveTexture(GL_TEXTURE0);
-			m_fontTexture[m_currentTexture - 1] = 1;
+	m_indices[m_currentIndex++] = (index + 0);
+	m_indices[m_currentIndex++] = (index + 1);
+	m_indices[m_currentIndex++] = (index + 2);
+}
+
+void Renderer2D::writeVertex(SBVertex& vertex, const Shape& shape, float x, float y, float u, float v, float w, float textureID) {
+	vertex.pos[0] = x;
+	vertex.pos[1] = y;
+	vertex.pos[2] = shape.depth;
+	vertex.pos[3] = textureID;
+	vertex.color[0] = shape.colour[0];
+	vertex.color[1] = shape.colour[1];
+	vertex.color[2] = shape.colour[2];
+	vertex.color[3] = shape.colour[3];
+	vertex.texcoord[0] = u;
+	vertex.texcoord[1] = v;
+	vertex.texcoord[2] = w;
+}
+
+void Renderer2D::setVertexAttributes() {
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)16);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)32);
+}
+
+void Renderer2D::drawCommands() {
+
+	unsigned int count = (unsigned int)m_sortItems.size();
+	m_sortScratch.resize(count);
+
+	// an 8-bit radix sort of the key above each index, which is stable so shapes with the same key keep the
+	// order they were drawn in. a pass where every key has the same byte would change nothing so is skipped
+	for (unsigned int shift = 32; shift < 64; shift += 8) {
+		unsigned int offsets[256] = {};
+		for (unsigned int i = 0; i < count; ++i)
+			offsets[(m_sortItems[i] >> shift) & 0xff]++;
+
+		if (count == 0 || offsets[(m_sortItems[0] >> shift) & 0xff] == count)
+			continue;
+
+		unsigned int total = 0;
+		for (unsigned int& offset : offsets) {
+			unsigned int bucket = offset;
+			offset = total;
+			total += bucket;
 		}
 
-		stbtt_GetBakedQuad((stbtt_bakedchar*)font->m_glyphData, font->m_textureWidth, font->m_textureHeight, (unsigned char)*text, &xPos, &yPos, &Q, 1);
-
-		int index = m_currentVertex;
-
-		m_vertices[m_currentVertex].pos[0] = Q.x0;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y1;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s0;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t1;
-		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x1;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y1;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s1;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t1;
-		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x1;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y0;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s1;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t0;
-		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x0;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y0;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s0;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t0;
-		m_currentVertex++;
-		
-		m_indices[m_currentIndex++] = (index + 0);
-		m_indices[m_currentIndex++] = (index + 2);
-		m_indices[m_currentIndex++] = (index + 3);
-
-		m_indices[m_currentIndex++] = (index + 0);
-		m_indices[m_currentIndex++] = (index + 1);
-		m_indices[m_currentIndex++] = (index + 2);
-
-		text++;
+		for (unsigned int i = 0; i < count; ++i)
+			m_sortScratch[offsets[(m_sortItems[i] >> shift) & 0xff]++] = m_sortItems[i];
+		m_sortItems.swap(m_sortScratch);
 	}
+
+	for (unsigned int i = 0; i < count; ++i)
+		writeShape(m_commands[(unsigned int)m_sortItems[i]]);
+
+	m_commands.clear();
+	m_sortItems.clear();
+
+	flushBatch();
+
+	bool deferred = m_deferred;
+	m_deferred = false;
+	for (auto text : m_staticTexts)
+		drawStaticText(text);
+	m_staticTexts.clear();
+	m_deferred = deferred;
+}
+
+void Renderer2D::setDeferred(bool deferred) {
+
+	// shapes recorded so far are drawn before any that follow
+	if (m_deferred && deferred == false && m_renderBegun)
+		drawCommands();
+
+	m_deferred = deferred;
 }
 
 bool Renderer2D::shouldFlush(int additionalVertices, int additionalIndices) {
-	return (m_currentVertex + additionalVertices) >= (MAX_SPRITES * 4) || 
-		(m_currentIndex + additionalIndices) >= (MAX_SPRITES * 6);
+	return (unsigned int)(m_currentVertex + additionalVertices) > m_maxVertices || 
+		(unsigned int)(m_currentIndex + additionalIndices) > m_maxIndices;
 }
 
 void Renderer2D::flushBatch() {
 
 	// dont render anything
-	if (m_currentVertex == 0 || m_currentIndex == 0 || m_renderBegun == false)
-		return; char buf[32];
-
-	for (int i = 0; i < TEXTURE_STACK_SIZE; ++i) {
-		sprintf_s(buf, "isFontTexture[%i]", i);
-		glUniform1i(glGetUniformLocation(m_shader, buf), m_fontTexture[i]);
-	}
+	if (m_renderBegun == false)
+		return;
 
-	int depthFunc = GL_LESS;
-	glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
-	glDepthFunc(GL_LEQUAL);
+	if (m_currentIndex > m_batchIndex) {
+		glUniform1iv(m_isFontTextureUniform, TEXTURE_STACK_SIZE, m_fontTexture);
 
-	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+		unsigned int depthFunc = GLState::get().depthFunc;
+		GLState::setDepthFunc(GL_LEQUAL);
 
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_currentVertex * sizeof(SBVertex), m_vertices);
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_currentIndex * sizeof(unsigned short), m_indices);
+		m_vertexStream->flush(m_currentVertex * sizeof(SBVertex));
+		m_indexStream->flush(m_currentIndex * sizeof(unsigned int));
 
-	glDrawElements(GL_TRIANGLES, m_currentIndex, GL_UNSIGNED_SHORT, 0);
+		// indices count from the start of the section, which the base vertex moves to
+		GLState::bindVertexArray(m_vao);
+		glDrawElementsBaseVertex(GL_TRIANGLES, m_currentIndex - m_batchIndex, GL_UNSIGNED_INT,
+								 (void*)(m_indexStream->getDrawOffset() + m_batchIndex * sizeof(unsigned int)),
+								 (int)(m_vertexStream->getDrawOffset() / sizeof(SBVertex)));
 
-	glBindVertexArray(0);
+		GLState::setDepthFunc(depthFunc);
+	}
 
-	glDepthFunc(depthFunc);
+	// without a persistent mapping each flush orphans the buffer and uploads from its start, so the
+	// next batch starts there too rather than uploading the batches already drawn again.
+	// otherwise once there isn't room for another shape move on to the next section of the ring,
+	// which waits only if the GPU is still drawing the batches that were written to it
+	if (m_vertexStream->isPersistent() == false ||
+		m_indexStream->isPersistent() == false) {
+		m_currentVertex = 0;
+		m_currentIndex = 0;
+	}
+	else if (shouldFlush(4, 6)) {
+		m_vertexStream->nextFrame();
+		m_indexStream->nextFrame();
+		m_vertices = (SBVertex*)m_vertexStream->getWritePointer();
+		m_indices = (unsigned int*)m_indexStream->getWritePointer();
+		m_currentVertex = 0;
+		m_currentIndex = 0;
+	}
 
 	// clear the active textures
 	for (unsigned int i = 0; i < m_currentTexture; i++) {
-		m_textureStack[i] = nullptr;
+		m_textureStack[i] = 0;
 		m_fontTexture[i] = 0;
 	}
 
-	// reset vertex, index and texture count
-	m_currentIndex = 0;
-	m_currentVertex = 0;
+	// the next batch starts where this one ended, and reset the texture count
+	m_batchVertex = m_currentVertex;
+	m_batchIndex = m_currentIndex;
 	m_currentTexture = 0;
 }
 
-unsigned int Renderer2D::pushTexture(Texture* texture) {
+unsigned int Renderer2D::pushTexture(unsigned int texture, int font) {
 
 	// check if the texture is already in use
 	// if so, return as we dont need to add it to our list of active txtures again
-	for (unsigned int i = 0; i <= m_currentTexture; i++) {
-		if (m_textureStack[i] == texture)
+	for (unsigned int i = 0; i < m_currentTexture; i++) {
+		if (m_textureStack[i] == texture &&
+			m_fontTexture[i] == font)
 			return i;
 	}
 
@@ -697,15 +751,28 @@ unsigned int Renderer2D::pushTexture(Texture* texture) {
 
 	// add the texture to our active texture list
 	m_textureStack[m_currentTexture] = texture;
+	m_fontTexture[m_currentTexture] = font;
 
-	glActiveTexture(GL_TEXTURE0 + m_currentTexture);
-	glBindTexture(GL_TEXTURE_2D, texture->getHandle());
-	glActiveTexture(GL_TEXTURE0);
+	GLState::bindTexture(texture, m_currentTexture);
 
 	// return what the current texture was and increment
 	return m_currentTexture++;
 }
 
+void Renderer2D::setTextureAtlas(TextureAtlas* atlas) {
+
+	// sprites already batched from the old atlas need drawing while it is still bound
+	if (m_renderBegun) {
+		if (m_deferred)
+			drawCommands();
+		flushBatch();
+		if (atlas != nullptr)
+			GLState::bindTextureArray(atlas->getHandle(), ATLAS_TEXTURE_UNIT);
+	}
+
+	m_atlas = atlas;
+}
+
 void Renderer2D::setRenderColour(float r, float g, float b, float a) {
 	m_r = r;
 	m_g = g;
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <vector>
+
 namespace aie {
 
 class Texture;
 class Font;
+class TextLayout;
+class StaticText;
+class StreamBuffer;
+class TextureAtlas;
 
 // a class for rendering 2D sprites and font
 class Renderer2D {
 public:
 
-	Renderer2D();
+	// batchSize is the number of sprites a single draw call can hold
+	Renderer2D(unsigned int batchSize = 8192);
 	virtual ~Renderer2D();
 
 	// all draw calls must occur between a begin / end pair
@@ -19,6 +26,7 @@ public:
 	// simple shape rendering
 	virtual void drawBox(float xPos, float yPos, float width, float height, float rotation = 0.0f, float depth = 0.0f);
 	virtual void drawCircle(float xPos, float yPos, float radius, float depth = 0.0f);
+	virtual void drawRing(float xPos, float yPos, float innerRadius, float outerRadius, float depth = 0.0f);
 
 	// if texture is nullptr then it renders a coloured sprite
 	// depth is in the range [0,100] with lower being closer to the viewer
@@ -32,8 +40,18 @@ public:
 
 	// draws simple text on the screen horizontally
 	// depth is in the range [0,100] with lower being closer to the viewer
+	// the layout of the text is cached by the font
 	virtual void drawText(Font* font, const char* text, float xPos, float yPos, float depth = 0.0f);
 
+	// draws text that has already been laid out, such as a layout that is updated as the text changes
+	virtual void drawText(const TextLayout& layout, float xPos, float yPos, float depth = 0.0f);
+
+	// lays out and uploads text that doesn't change, using the current colour. the caller deletes it
+	StaticText* createStaticText(Font* font, const char* text, float xPos, float yPos, float depth = 0.0f);
+
+	// draws static text without writing any vertices, which takes its own draw call
+	void drawStaticText(StaticText* text);
+
 	// sets the tint colour for all subsequent draw calls
 	void setRenderColour(float r, float g, float b, float a = 1.0f);
 	void setRenderColour(unsigned int colour);
@@ -42,6 +60,17 @@ public:
 	// for all subsequent drawSprite calls
 	void setUVRect(float uvX, float uvY, float uvW, float uvH);
 
+	// sprites using a texture that has been added to the atlas are drawn from it instead. they don't take
+	// a place in the texture stack, so any number of them can be drawn without flushing. nullptr stops using it
+	void setTextureAtlas(TextureAtlas* atlas);
+	TextureAtlas* getTextureAtlas() const { return m_atlas; }
+
+	// in deferred mode draw calls are recorded and drawn at end(), sorted from the farthest depth to the nearest
+	// and grouped by texture within a depth, so that as few batches as possible are drawn. shapes with the
+	// same depth and texture are still drawn in the order they were called
+	void setDeferred(bool deferred);
+	bool isDeferred() const { return m_deferred; }
+
 	// specify the camera position
 	void setCameraPos(float x, float y) { m_cameraX = x; m_cameraY = y; }
 	void getCameraPos(float& x, float& y) const { x = m_cameraX; y = m_cameraY; }
@@ -51,7 +80,54 @@ protected:
 	// helper methods used during drawing
 	bool shouldFlush(int additionalVertices = 0, int additionalIndices = 0);
 	void flushBatch();
-	unsigned int pushTexture(Texture* texture);
+	unsigned int pushTexture(unsigned int texture, int font);
+
+	// how the shader reads a texture in the stack, as fonts only have a red channel
+	enum FontType : int {
+		FONT_NONE,
+		FONT_BITMAP,
+		FONT_DISTANCE_FIELD
+	};
+
+	// sprite vertices, every shape is a quad
+	struct SBVertex {
+		float pos[4];
+		float color[4];
+		float texcoord[3];	// the third coordinate is the atlas layer, or a ring's inner radius
+	};
+
+	// every draw call is turned into a shape, which is written into the batch or recorded in deferred mode.
+	// quad corners take the texture coordinates (u0,v1), (u1,v1), (u1,v0) and (u0,v0) in order. circles
+	// are centred on x[0], y[0] with radius x[1] and inner radius x[2], and lines go from the first point
+	// to the second with thickness x[2]. circles and lines are drawn by the shader as distance fields
+	enum ShapeType : unsigned int {
+		SHAPE_QUAD,
+		SHAPE_CIRCLE,
+		SHAPE_LINE
+	};
+	struct Shape {
+		ShapeType		type;
+		unsigned int	texture;	// gl handle of the texture, font or atlas, 0 for circles and lines
+		int				font;		// a FontType
+		bool			atlas;
+		float			x[4], y[4];
+		float			u0, v0, u1, v1;
+		float			layer;
+		float			depth;
+		float			colour[4];
+	};
+
+	// sets up a shape with the current colour and uv rect, which is remapped if the texture is in the atlas
+	void initShape(Shape& shape, ShapeType type, Texture* texture, float depth);
+	void submitShape(const Shape& shape);
+	void writeShape(const Shape& shape);
+	void writeVertex(SBVertex& vertex, const Shape& shape, float x, float y, float u, float v, float w, float textureID);
+
+	// sets the attributes of SBVertex on the bound vertex array
+	void setVertexAttributes();
+
+	// sorts the recorded shapes and writes them into batches
+	void drawCommands();
 
 	// indicates in the middle of a begin/end pair
 	bool				m_renderBegun;
@@ -60,10 +136,19 @@ protected:
 	float				m_cameraX, m_cameraY;
 
 	// texture handling
-	enum { TEXTURE_STACK_SIZE = 16 };
+	// the atlas is bound to the unit after the texture stack, and the shader samples it for that texture id.
+	// the ids after it draw circles and lines, which don't need a texture
+	enum {
+		TEXTURE_STACK_SIZE = 16,
+		ATLAS_TEXTURE_ID = TEXTURE_STACK_SIZE,
+		ATLAS_TEXTURE_UNIT = TEXTURE_STACK_SIZE,
+		CIRCLE_TEXTURE_ID,
+		LINE_TEXTURE_ID
+	};
 	Texture*			m_nullTexture;
-	Texture*			m_textureStack[TEXTURE_STACK_SIZE];
-	int					m_fontTexture[TEXTURE_STACK_SIZE];
+	TextureAtlas*		m_atlas;
+	unsigned int		m_textureStack[TEXTURE_STACK_SIZE];	// gl handles
+	int					m_fontTexture[TEXTURE_STACK_SIZE];	// FontType of each texture
 	unsigned int		m_currentTexture;
 
 	// texture coordinate information
@@ -72,22 +157,27 @@ protected:
 	// represents colour in red, green, blue and alpha 0.0-1.0 range
 	float				m_r, m_g, m_b, m_a;
 
-	// sprite handling
-	enum { MAX_SPRITES = 512 };
-	struct SBVertex {
-		float pos[4];
-		float color[4];
-		float texcoord[2];
-	};
-
-	// data used for opengl to draw the sprites (with padding)
-	SBVertex			m_vertices[MAX_SPRITES * 4];
-	unsigned short		m_indices[MAX_SPRITES * 6];
+	// data used for opengl to draw the sprites, written into the current section of the streams.
+	// the current counts are where the next shape goes, and the batch counts where the unflushed batch starts
+	SBVertex*			m_vertices;
+	unsigned int*		m_indices;
 	int					m_currentVertex, m_currentIndex;
-	unsigned int		m_vao, m_vbo, m_ibo;
-
-	// shader used to render sprites
+	int					m_batchVertex, m_batchIndex;
+	unsigned int		m_maxVertices, m_maxIndices;
+	StreamBuffer*		m_vertexStream;
+	StreamBuffer*		m_indexStream;
+	unsigned int		m_vao;
+
+	// shapes recorded in deferred mode, and their sort key above their index
+	bool								m_deferred;
+	std::vector<Shape>					m_commands;
+	std::vector<unsigned long long>		m_sortItems, m_sortScratch;
+	std::vector<StaticText*>			m_staticTexts;
+
+	// shader used to render sprites, and its uniform locations
 	unsigned int		m_shader;
+	int					m_projectionMatrixUniform;
+	int					m_isFontTextureUniform;
 
 	// helper method used to rotate sprites around a pivot
 	void	rotateAround(float inX, float inY, float& outX, float& outY, float sin, float cos);
@@ -0,0 +1,21 @@
+#include "gl_core_4_4.h"
+#include "GLState.h"
+#include "StaticText.h"
+
+namespace aie {
+
+StaticText::StaticText(Font* font, const char* str)
+	: m_layout(font, str),
+	m_vao(0),
+	m_vbo(0),
+	m_ibo(0),
+	m_indexCount(0) {
+}
+
+StaticText::~StaticText() {
+	GLState::deleteVertexArrays(1, &m_vao);
+	GLState::deleteBuffers(1, &m_vbo);
+	GLState::deleteBuffers(1, &m_ibo);
+}
+
+} // namespace aie
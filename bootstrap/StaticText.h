@@ -0,0 +1,31 @@
+#pragma once
+
+#include "TextLayout.h"
+
+namespace aie {
+
+class Font;
+
+// text that doesn't change, laid out and uploaded to the GPU once by Renderer2D::createStaticText.
+// it keeps the position and colour it was created with, and is drawn with Renderer2D::drawStaticText.
+// the font must outlive it
+class StaticText {
+
+	friend class Renderer2D;
+
+public:
+
+	~StaticText();
+
+	const TextLayout& getLayout() const { return m_layout; }
+
+protected:
+
+	StaticText(Font* font, const char* str);
+
+	TextLayout		m_layout;
+	unsigned int	m_vao, m_vbo, m_ibo;
+	unsigned int	m_indexCount;
+};
+
+} // namespace aie
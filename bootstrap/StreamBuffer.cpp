@@ -0,0 +1,99 @@
+#include "StreamBuffer.h"
+#include "gl_core_4_4.h"
+#include "GLState.h"
+
+namespace aie {
+
+StreamBuffer::StreamBuffer(size_t sectionSize, unsigned int sectionCount)
+	: m_buffer(0),
+	m_sectionSize(sectionSize),
+	m_sectionCount(sectionCount > 0 ? sectionCount : 1),
+	m_section(0),
+	m_persistent(false),
+	m_mapped(nullptr),
+	m_writePointer(nullptr) {
+
+	glGenBuffers(1, &m_buffer);
+	GLState::bindArrayBuffer(m_buffer);
+
+	// glBufferStorage is only loaded if the driver supports GL 4.4 or ARB_buffer_storage
+	if (glBufferStorage != nullptr && m_sectionSize > 0) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, m_sectionSize * m_sectionCount, nullptr, flags);
+		m_mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, m_sectionSize * m_sectionCount, flags);
+		m_persistent = m_mapped != nullptr;
+
+		// immutable storage can't be respecified, so fall back to a new buffer if mapping failed
+		if (m_persistent == false) {
+			GLState::deleteBuffers(1, &m_buffer);
+			glGenBuffers(1, &m_buffer);
+			GLState::bindArrayBuffer(m_buffer);
+		}
+	}
+
+	if (m_persistent) {
+		m_fences.assign(m_sectionCount, nullptr);
+		m_writePointer = m_mapped;
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, m_sectionSize, nullptr, GL_STREAM_DRAW);
+		m_staging.resize(m_sectionSize);
+		m_writePointer = m_staging.data();
+	}
+
+	GLState::bindArrayBuffer(0);
+}
+
+StreamBuffer::~StreamBuffer() {
+
+	for (auto fence : m_fences)
+		if (fence != nullptr)
+			glDeleteSync(fence);
+
+	if (m_persistent) {
+		GLState::bindArrayBuffer(m_buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		GLState::bindArrayBuffer(0);
+	}
+
+	GLState::deleteBuffers(1, &m_buffer);
+}
+
+void StreamBuffer::flush(size_t byteCount) {
+
+	// the persistent mapping is coherent, so written data is already visible
+	if (m_persistent || byteCount == 0)
+		return;
+
+	// orphan the old storage so that the upload doesn't wait for draws still using it
+	GLState::bindArrayBuffer(m_buffer);
+	glBufferData(GL_ARRAY_BUFFER, m_sectionSize, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, byteCount, m_staging.data());
+}
+
+void StreamBuffer::nextFrame() {
+
+	if (m_persistent == false)
+		return;
+
+	// everything drawn from the current section has been submitted, so fence it
+	if (m_fences[m_section] != nullptr)
+		glDeleteSync(m_fences[m_section]);
+	m_fences[m_section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_section = (m_section + 1) % m_sectionCount;
+
+	// wait until the GPU has finished drawing the frame that last used this section
+	if (m_fences[m_section] != nullptr) {
+		GLenum result = glClientWaitSync(m_fences[m_section], 0, 0);
+		while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+			result = glClientWaitSync(m_fences[m_section], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+		glDeleteSync(m_fences[m_section]);
+		m_fences[m_section] = nullptr;
+	}
+
+	m_writePointer = m_mapped + m_section * m_sectionSize;
+}
+
+} // namespace aie
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// matches GLsync from gl_core_4_4.h without including it
+struct __GLsync;
+
+namespace aie {
+
+// a vertex buffer that is rewritten by the CPU every frame. the buffer is split into
+// a number of sections (one per frame in flight), and each frame writes to the next one.
+// when glBufferStorage is available the buffer is persistently mapped so data is written
+// straight into GPU-visible memory, and each section is fenced so it is never written
+// while the GPU may still be drawing from it. otherwise data is written to CPU memory and
+// uploaded into an orphaned buffer by flush(), which also avoids waiting on the GPU
+class StreamBuffer {
+public:
+
+	StreamBuffer(size_t sectionSize, unsigned int sectionCount = 3);
+	~StreamBuffer();
+
+	// the memory to write this frame's data to, sectionSize bytes long
+	void*			getWritePointer() const { return m_writePointer; }
+
+	// makes the first byteCount bytes written this frame visible to the GPU
+	void			flush(size_t byteCount);
+
+	// fences the current section and moves to the next one, waiting until the GPU has
+	// finished with it. getWritePointer() changes, so call this before writing a new frame
+	void			nextFrame();
+
+	// the buffer to bind for drawing, and the byte offset of this frame's data within it
+	unsigned int	getBuffer() const { return m_buffer; }
+	size_t			getDrawOffset() const { return m_persistent ? m_section * m_sectionSize : 0; }
+
+	size_t			getSectionSize() const { return m_sectionSize; }
+	bool			isPersistent() const { return m_persistent; }
+
+private:
+
+	unsigned int	m_buffer;
+	size_t			m_sectionSize;
+	unsigned int	m_sectionCount;
+	unsigned int	m_section;
+	bool			m_persistent;
+
+	// persistent mapping of the whole buffer, and a fence for each section
+	char*						m_mapped;
+	std::vector<__GLsync*>		m_fences;
+
+	// CPU copy used when persistent mapping isn't available
+	std::vector<char>			m_staging;
+
+	void*			m_writePointer;
+};
+
+} // namespace aie
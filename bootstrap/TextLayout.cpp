@@ -0,0 +1,71 @@
+#include "TextLayout.h"
+#include "Font.h"
+
+namespace aie {
+
+TextLayout::TextLayout()
+	: m_font(nullptr),
+	m_minX(9999999),
+	m_minY(9999999),
+	m_maxX(-9999999),
+	m_maxY(-9999999) {
+}
+
+TextLayout::TextLayout(Font* font, const char* str)
+	: m_font(nullptr),
+	m_minX(9999999),
+	m_minY(9999999),
+	m_maxX(-9999999),
+	m_maxY(-9999999) {
+
+	set(font, str);
+}
+
+void TextLayout::set(Font* font, const char* str) {
+
+	// find the first character that changed, the glyphs before it are still in the right place
+	size_t keep = 0;
+	if (font == m_font) {
+		while (keep < m_string.size() && str[keep] != 0 && str[keep] == m_string[keep])
+			keep++;
+
+		if (keep == m_string.size() && str[keep] == 0)
+			return;
+	}
+
+	m_font = font;
+	m_string.assign(str);
+	m_glyphs.resize(keep);
+	m_pens.resize(keep);
+
+	if (font != nullptr &&
+		font->m_glyphData != nullptr) {
+
+		float xPos = keep > 0 ? m_pens[keep - 1] : 0.0f;
+
+		for (size_t i = keep; i < m_string.size(); ++i) {
+			Glyph glyph;
+			font->layoutGlyph((unsigned char)m_string[i], xPos, glyph);
+			m_glyphs.push_back(glyph);
+			m_pens.push_back(xPos);
+		}
+	}
+
+	m_minX = 9999999, m_minY = 9999999;
+	m_maxX = -9999999, m_maxY = -9999999;
+	for (auto& glyph : m_glyphs) {
+		m_minX = m_minX > glyph.x0 ? glyph.x0 : m_minX;
+		m_minY = m_minY > glyph.y0 ? glyph.y0 : m_minY;
+		m_maxX = m_maxX < glyph.x1 ? glyph.x1 : m_maxX;
+		m_maxY = m_maxY < glyph.y1 ? glyph.y1 : m_maxY;
+	}
+}
+
+void TextLayout::getBounds(float& minX, float& minY, float& maxX, float& maxY) const {
+	minX = m_minX;
+	minY = m_minY;
+	maxX = m_maxX;
+	maxY = m_maxY;
+}
+
+} // namespace aie
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace aie {
+
+class Font;
+
+// the glyph quads of a string laid out from the origin, with y going down as stb_truetype places them.
+// setting a new string only lays out the glyphs from the first character that changed, so text that
+// changes a little each frame, such as a counter, can keep a layout and update it cheaply
+class TextLayout {
+public:
+
+	struct Glyph {
+		float x0, y0, x1, y1;	// position
+		float s0, t0, s1, t1;	// texture coordinates
+	};
+
+	TextLayout();
+	TextLayout(Font* font, const char* str);
+
+	void set(Font* font, const char* str);
+
+	Font* getFont() const { return m_font; }
+	const std::string& getString() const { return m_string; }
+	const std::vector<Glyph>& getGlyphs() const { return m_glyphs; }
+
+	// the right edge of the last glyph
+	float getWidth() const { return m_glyphs.empty() ? 0.0f : m_glyphs.back().x1; }
+
+	// height includes glyphs that go below starting height
+	float getHeight() const { return m_maxY - m_minY; }
+
+	// the smallest and largest glyph positions
+	void getBounds(float& minX, float& minY, float& maxX, float& maxY) const;
+
+protected:
+
+	Font*				m_font;
+	std::string			m_string;
+	std::vector<Glyph>	m_glyphs;
+
+	// the pen position after each glyph, where layout carries on from if the next character changes
+	std::vector<float>	m_pens;
+
+	float				m_minX, m_minY, m_maxX, m_maxY;
+};
+
+} // namespace aie
@@ -1,5 +1,11 @@
 #include "gl_core_4_4.h"
+#include "GLState.h"
 #include "Texture.h"
+#include "AssetCache.h"
+#include "TextureLoader.h"
+#include "TextureManager.h"
+#include <vector>
+#include <string.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -12,16 +18,30 @@ Texture::Texture()
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_keepPixels(false),
+	m_mipmapped(false),
+	m_loading(false),
+	m_evicted(false),
+	m_lastUsed(0) {
+
+	TextureManager::add(this);
 }
 
-Texture::Texture(const char * filename)
+Texture::Texture(const char * filename, bool keepPixels)
 	: m_filename("none"),
 	m_width(0),
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_keepPixels(keepPixels),
+	m_mipmapped(false),
+	m_loading(false),
+	m_evicted(false),
+	m_lastUsed(0) {
+
+	TextureManager::add(this);
 
 	load(filename);
 }
@@ -30,84 +50,168 @@ Texture::Texture(unsigned int width, unsigned int height, Format format, unsigne
 	: m_filename("none"),
 	m_width(width),
 	m_height(height),
+	m_glHandle(0),
 	m_format(format),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_keepPixels(false),
+	m_mipmapped(false),
+	m_loading(false),
+	m_evicted(false),
+	m_lastUsed(0) {
+
+	TextureManager::add(this);
 
 	create(width, height, format, pixels);
 }
 
 Texture::~Texture() {
+	TextureManager::remove(this);
+	if (m_loading)
+		TextureLoader::cancel(this);
 	if (m_glHandle != 0)
-		glDeleteTextures(1, &m_glHandle);
+		GLState::deleteTextures(1, &m_glHandle);
 	if (m_loadedPixels != nullptr)
 		stbi_image_free(m_loadedPixels);
 }
 
 bool Texture::load(const char* filename) {
 
+	int x = 0, y = 0, comp = 0;
+	unsigned char* pixels = decode(filename, x, y, comp);
+	if (pixels == nullptr) {
+		release();
+		return false;
+	}
+
+	createFromPixels(filename, pixels, x, y, comp, false);
+	return true;
+}
+
+void Texture::release() {
+
+	if (m_loading) {
+		TextureLoader::cancel(this);
+		m_loading = false;
+	}
 	if (m_glHandle != 0) {
-		glDeleteTextures(1, &m_glHandle);
+		GLState::deleteTextures(1, &m_glHandle);
 		m_glHandle = 0;
-		m_width = 0;
-		m_height = 0;
-		m_filename = "none";
 	}
+	if (m_loadedPixels != nullptr) {
+		stbi_image_free(m_loadedPixels);
+		m_loadedPixels = nullptr;
+	}
+	m_width = 0;
+	m_height = 0;
+	m_filename = "none";
+	m_mipmapped = false;
+	m_evicted = false;
+}
 
-	int x = 0, y = 0, comp = 0;
-	m_loadedPixels = stbi_load(filename, &x, &y, &comp, STBI_default);
+unsigned char* Texture::decode(const char* filename, int& width, int& height, int& components) {
 
-	if (m_loadedPixels != nullptr) {
-		glGenTextures(1, &m_glHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glHandle);
-		switch (comp) {
-		case STBI_grey:
-			m_format = RED;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, x, y,
-						 0, GL_RED, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_grey_alpha:
-			m_format = RG;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, x, y,
-						 0, GL_RG, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb:
-			m_format = RGB;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y,
-						 0, GL_RGB, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb_alpha:
-			m_format = RGBA;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y,
-						 0, GL_RGBA, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		default:	break;
-		};
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		m_width = (unsigned int)x;
-		m_height = (unsigned int)y;
-		m_filename = filename;
-		return true;
+	// the decoded pixels are cached under a hash of the file, so a warm launch skips decoding
+	std::vector<unsigned char> file;
+	if (AssetCache::readFile(filename, file) == false)
+		return nullptr;
+	unsigned long long key = AssetCache::hash(file.data(), file.size());
+
+	std::vector<unsigned char> blob;
+	if (AssetCache::load("texture", key, blob) &&
+		blob.size() > sizeof(int) * 3) {
+
+		// the blob is the width, height and component count followed by the pixels
+		const int* header = (const int*)blob.data();
+		size_t size = blob.size() - sizeof(int) * 3;
+		if (header[0] > 0 && header[1] > 0 && header[2] > 0 &&
+			size == (size_t)header[0] * header[1] * header[2]) {
+			width = header[0], height = header[1], components = header[2];
+
+			// allocated the way stb_image allocates so stbi_image_free can release it
+			unsigned char* pixels = (unsigned char*)STBI_MALLOC(size);
+			memcpy(pixels, blob.data() + sizeof(int) * 3, size);
+			return pixels;
+		}
 	}
-	return false;
+
+	unsigned char* pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &components, STBI_default);
+	if (pixels != nullptr) {
+		size_t size = (size_t)width * height * components;
+		blob.resize(sizeof(int) * 3 + size);
+		int header[3] = { width, height, components };
+		memcpy(blob.data(), header, sizeof(header));
+		memcpy(blob.data() + sizeof(header), pixels, size);
+		AssetCache::store("texture", key, blob.data(), blob.size());
+	}
+	return pixels;
+}
+
+void Texture::createFromPixels(const char* filename, unsigned char* pixels, int width, int height, int components,
+							   bool fromPixelBuffer) {
+
+	release();
+
+	// texels come from the start of the bound pixel unpack buffer instead of the pixels if there is one
+	const unsigned char* texels = fromPixelBuffer ? nullptr : pixels;
+
+	// decoded rows are tightly packed, so rows of RED and RGB pixels aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glGenTextures(1, &m_glHandle);
+	GLState::bindTexture(m_glHandle);
+	switch (components) {
+	case STBI_grey:
+		m_format = RED;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height,
+					 0, GL_RED, GL_UNSIGNED_BYTE, texels);
+		break;
+	case STBI_grey_alpha:
+		m_format = RG;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, width, height,
+					 0, GL_RG, GL_UNSIGNED_BYTE, texels);
+		break;
+	case STBI_rgb:
+		m_format = RGB;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height,
+					 0, GL_RGB, GL_UNSIGNED_BYTE, texels);
+		break;
+	case STBI_rgb_alpha:
+		m_format = RGBA;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
+					 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+		break;
+	default:	break;
+	};
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	GLState::bindTexture(0);
+	m_width = (unsigned int)width;
+	m_height = (unsigned int)height;
+	m_filename = filename;
+	m_mipmapped = true;
+
+	if (m_keepPixels)
+		m_loadedPixels = pixels;
+	else
+		stbi_image_free(pixels);
+}
+
+void Texture::freePixels(unsigned char* pixels) {
+	stbi_image_free(pixels);
 }
 
 void Texture::create(unsigned int width, unsigned int height, Format format, unsigned char* pixels) {
 
-	if (m_glHandle != 0) {
-		glDeleteTextures(1, &m_glHandle);
-		m_glHandle = 0;
-		m_filename = "none";
-	}
+	release();
 
 	m_width = width;
 	m_height = height;
 	m_format = format;
 
 	glGenTextures(1, &m_glHandle);
-	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	GLState::bindTexture(m_glHandle);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -130,12 +234,26 @@ void Texture::create(unsigned int width, unsigned int height, Format format, uns
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 	};
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(0);
 }
 
 void Texture::bind(unsigned int slot) const {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	TextureManager::touch(this);
+	GLState::bindTexture(m_glHandle, slot);
+}
+
+size_t Texture::getGPUBytes() const {
+
+	if (m_glHandle == 0)
+		return 0;
+
+	// each format's value is its number of components, and a full mip chain adds a third
+	size_t bytes = (size_t)m_width * m_height * m_format;
+	return m_mipmapped ? bytes + bytes / 3 : bytes;
+}
+
+size_t Texture::getCPUBytes() const {
+	return m_loadedPixels != nullptr ? (size_t)m_width * m_height * m_format : 0;
 }
 
 } // namespace aie
\ No newline at end of file
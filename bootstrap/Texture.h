@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
 
 namespace aie {
 
@@ -16,7 +17,7 @@ public:
 	};
 
 	Texture();
-	Texture(const char* filename);
+	Texture(const char* filename, bool keepPixels = false);
 	Texture(unsigned int width, unsigned int height, Format format, unsigned char* pixels = nullptr);
 	virtual ~Texture();
 
@@ -29,25 +30,60 @@ public:
 	// returns the filename or "none" if not loaded from a file
 	const std::string& getFilename() const { return m_filename; }
 
-	// binds the texture to the specified slot
+	// binds the texture to the specified slot, which counts as using it for TextureManager
 	void bind(unsigned int slot) const;
 
-	// returns the opengl texture handle
+	// returns the opengl texture handle, which is 0 until a texture from TextureLoader has loaded
 	unsigned int getHandle() const { return m_glHandle; }
 
+	// true while a TextureLoader is still decoding or uploading the texture
+	bool isLoading() const { return m_loading; }
+
+	// true once TextureManager has freed the texture to stay within its budget. it loads again when it is used
+	bool isEvicted() const { return m_evicted; }
+
 	unsigned int getWidth() const { return m_width; }
 	unsigned int getHeight() const { return m_height; }
 	unsigned int getFormat() const { return m_format; }
+
+	// the pixels loaded from a file are freed once they are uploaded unless this is set before loading
+	void setKeepPixels(bool keep) { m_keepPixels = keep; }
 	const unsigned char* getPixels() const { return m_loadedPixels; }
 
+	// the bytes used by the GL texture, including its mipmaps, and by the kept pixels
+	size_t getGPUBytes() const;
+	size_t getCPUBytes() const;
+
 protected:
 
+	friend class TextureLoader;
+	friend class TextureManager;
+
+	// deletes the texture and its pixels, and stops it loading
+	void release();
+
+	// reads an image's pixels, from the asset cache if it has been decoded before. safe to call from any thread
+	static unsigned char* decode(const char* filename, int& width, int& height, int& components);
+	static void freePixels(unsigned char* pixels);
+
+	// creates the texture from decoded pixels and keeps them. the texels are read from the bound pixel
+	// unpack buffer instead when fromPixelBuffer is set
+	void createFromPixels(const char* filename, unsigned char* pixels, int width, int height, int components,
+						  bool fromPixelBuffer);
+
 	std::string		m_filename;
 	unsigned int	m_width;
 	unsigned int	m_height;
 	unsigned int	m_glHandle;
 	unsigned int	m_format;
 	unsigned char*	m_loadedPixels;
+	bool			m_keepPixels;
+	bool			m_mipmapped;
+	bool			m_loading;
+
+	// residency bookkeeping, which changes when a const texture is bound
+	mutable bool			m_evicted;
+	mutable unsigned int	m_lastUsed;	// the TextureManager frame the texture was last used in
 };
 
 } // namespace aie
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "gl_core_4_4.h"
+#include "GLState.h"
+#include "TextureAtlas.h"
+#include "Texture.h"
+#include "TextureManager.h"
+
+// imgui builds its own static copy, so this one is kept private to this file as well
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <stb_rect_pack.h>
+
+namespace aie {
+
+struct TextureAtlas::Layer {
+	stbrp_context				packer;
+	std::vector<stbrp_node>		nodes;
+};
+
+TextureAtlas::TextureAtlas(unsigned int width, unsigned int height, unsigned int layers)
+	: m_glHandle(0),
+	m_width(width),
+	m_height(height),
+	m_layerCount(layers > 0 ? layers : 1) {
+
+	glGenTextures(1, &m_glHandle);
+	GLState::bindTextureArray(m_glHandle);
+
+	// the texels are cleared so the gaps between textures are transparent
+	std::vector<unsigned char> clear(m_width * m_height * 4, 0);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, m_width, m_height, m_layerCount,
+				 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	for (unsigned int i = 0; i < m_layerCount; ++i)
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, m_width, m_height, 1,
+						GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLState::bindTextureArray(0);
+
+	TextureManager::addAtlas(this);
+}
+
+TextureAtlas::~TextureAtlas() {
+	TextureManager::removeAtlas(this);
+	for (auto layer : m_layers)
+		delete layer;
+	if (m_glHandle != 0)
+		GLState::deleteTextures(1, &m_glHandle);
+}
+
+bool TextureAtlas::add(Texture* texture) {
+
+	if (texture == nullptr ||
+		texture->getHandle() == 0 ||
+		texture->getWidth() > m_width ||
+		texture->getHeight() > m_height)
+		return false;
+
+	if (m_regions.find(texture) != m_regions.end())
+		return true;
+
+	// leave a gap around each texture so filtering doesn't pick up its neighbours,
+	// unless it only fits without one
+	int gapX = texture->getWidth() + 2 <= m_width ? 1 : 0;
+	int gapY = texture->getHeight() + 2 <= m_height ? 1 : 0;
+
+	stbrp_rect rect = {};
+	rect.w = (stbrp_coord)(texture->getWidth() + gapX * 2);
+	rect.h = (stbrp_coord)(texture->getHeight() + gapY * 2);
+
+	// try each used layer before starting a new one
+	unsigned int layer = 0;
+	for (; layer < m_layerCount; ++layer) {
+
+		if (layer == m_layers.size()) {
+			Layer* newLayer = new Layer();
+			newLayer->nodes.resize(m_width);
+			stbrp_init_target(&newLayer->packer, m_width, m_height, newLayer->nodes.data(), (int)m_width);
+			m_layers.push_back(newLayer);
+		}
+
+		stbrp_pack_rects(&m_layers[layer]->packer, &rect, 1);
+		if (rect.was_packed != 0)
+			break;
+	}
+
+	if (layer == m_layerCount)
+		return false;
+
+	int x = rect.x + gapX;
+	int y = rect.y + gapY;
+	copy(texture, layer, x, y);
+
+	Region region;
+	region.layer = layer;
+	region.uvX = x / (float)m_width;
+	region.uvY = y / (float)m_height;
+	region.uvW = texture->getWidth() / (float)m_width;
+	region.uvH = texture->getHeight() / (float)m_height;
+	m_regions[texture] = region;
+
+	return true;
+}
+
+void TextureAtlas::remove(const Texture* texture) {
+	m_regions.erase(texture);
+}
+
+const TextureAtlas::Region* TextureAtlas::find(const Texture* texture) const {
+	auto iter = m_regions.find(texture);
+	return iter == m_regions.end() ? nullptr : &iter->second;
+}
+
+void TextureAtlas::copy(Texture* texture, unsigned int layer, int x, int y) {
+
+	unsigned int width = texture->getWidth();
+	unsigned int height = texture->getHeight();
+
+	// RGBA textures can be copied on the GPU when glCopyImageSubData (GL 4.3) is available
+	if (texture->getFormat() == Texture::RGBA &&
+		glCopyImageSubData != nullptr) {
+		glCopyImageSubData(texture->getHandle(), GL_TEXTURE_2D, 0, 0, 0, 0,
+						   m_glHandle, GL_TEXTURE_2D_ARRAY, 0, x, y, layer,
+						   width, height, 1);
+		return;
+	}
+
+	// otherwise upload the loaded pixels, or read them back from the texture if it kept none.
+	// either way GL expands them to RGBA the same way it does when sampling the texture
+	unsigned int format = GL_RGBA;
+	const unsigned char* pixels = texture->getPixels();
+	std::vector<unsigned char> readBack;
+
+	if (pixels != nullptr) {
+		switch (texture->getFormat()) {
+		case Texture::RED:	format = GL_RED;	break;
+		case Texture::RG:	format = GL_RG;		break;
+		case Texture::RGB:	format = GL_RGB;	break;
+		default:	break;
+		};
+	}
+	else {
+		readBack.resize(width * height * 4);
+		GLState::bindTexture(texture->getHandle());
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, readBack.data());
+		GLState::bindTexture(0);
+		pixels = readBack.data();
+	}
+
+	// rows of RED and RGB pixels aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	GLState::bindTextureArray(m_glHandle);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, width, height, 1,
+					format, GL_UNSIGNED_BYTE, pixels);
+	GLState::bindTextureArray(0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+} // namespace aie
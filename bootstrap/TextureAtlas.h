@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+namespace aie {
+
+class Texture;
+
+// packs many textures into the layers of a single GL_TEXTURE_2D_ARRAY, so that sprites using any
+// of them can be drawn together without changing textures. a texture the size of a layer takes a
+// whole layer, and smaller ones are packed into layers with a 1 texel gap between them.
+// the atlas holds a copy of the texels, so the textures can be drawn normally as well
+class TextureAtlas {
+public:
+
+	// where a texture's texels are within the atlas
+	struct Region {
+		unsigned int	layer;
+		float			uvX, uvY, uvW, uvH;
+	};
+
+	// all layers are allocated up front, as a texture array can't grow in place
+	TextureAtlas(unsigned int width = 1024, unsigned int height = 1024, unsigned int layers = 4);
+	~TextureAtlas();
+
+	// copies a texture into the atlas. returns false if it doesn't fit in any layer
+	bool add(Texture* texture);
+
+	// forgets a texture, which deleting the texture also does. its space isn't reused
+	void remove(const Texture* texture);
+
+	// returns nullptr if the texture isn't in the atlas
+	const Region* find(const Texture* texture) const;
+
+	unsigned int getHandle() const { return m_glHandle; }
+
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+	unsigned int getLayerCount() const { return m_layerCount; }
+
+protected:
+
+	// copies the texels of a texture into a layer at the given position
+	void copy(Texture* texture, unsigned int layer, int x, int y);
+
+	struct Layer;
+
+	unsigned int		m_glHandle;
+	unsigned int		m_width, m_height;
+	unsigned int		m_layerCount;
+
+	// packing state for the layers that have been used so far
+	std::vector<Layer*>	m_layers;
+
+	std::unordered_map<const Texture*, Region>	m_regions;
+};
+
+} // namespace aie
@@ -0,0 +1,197 @@
+#include "gl_core_4_4.h"
+#include <GLFW/glfw3.h>
+#include "TextureLoader.h"
+#include "Texture.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace aie {
+
+std::vector<std::thread> TextureLoader::sm_workers;
+std::mutex TextureLoader::sm_mutex;
+std::condition_variable TextureLoader::sm_condition;
+bool TextureLoader::sm_quit = false;
+std::deque<TextureLoader::Job*> TextureLoader::sm_queued;
+std::vector<TextureLoader::Job*> TextureLoader::sm_decoding;
+std::deque<TextureLoader::Job*> TextureLoader::sm_decoded;
+unsigned int TextureLoader::sm_pixelBuffer = 0;
+
+Texture* TextureLoader::load(const char* filename) {
+	Texture* texture = new Texture();
+	load(texture, filename);
+	return texture;
+}
+
+void TextureLoader::load(Texture* texture, const char* filename) {
+
+	// a newer load replaces one that hasn't finished
+	if (texture->m_loading)
+		cancel(texture);
+	texture->m_loading = true;
+
+	Job* job = new Job();
+	job->texture = texture;
+	job->filename = filename;
+	job->pixels = nullptr;
+	job->width = job->height = job->components = 0;
+
+	std::lock_guard<std::mutex> lock(sm_mutex);
+
+	// the workers start with the first load, leaving a core for the frame loop
+	if (sm_workers.empty()) {
+		sm_quit = false;
+		unsigned int count = std::thread::hardware_concurrency();
+		count = count > 1 ? std::min(count - 1, 4u) : 1;
+		for (unsigned int i = 0; i < count; ++i)
+			sm_workers.push_back(std::thread(work));
+	}
+
+	sm_queued.push_back(job);
+	sm_condition.notify_one();
+}
+
+void TextureLoader::work() {
+
+	while (true) {
+
+		Job* job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(sm_mutex);
+			sm_condition.wait(lock, []() { return sm_quit || sm_queued.empty() == false; });
+			if (sm_quit)
+				return;
+
+			job = sm_queued.front();
+			sm_queued.pop_front();
+
+			// the texture was deleted while it waited
+			if (job->texture == nullptr) {
+				delete job;
+				continue;
+			}
+			sm_decoding.push_back(job);
+		}
+
+		job->pixels = Texture::decode(job->filename.c_str(), job->width, job->height, job->components);
+
+		std::lock_guard<std::mutex> lock(sm_mutex);
+		sm_decoding.erase(std::find(sm_decoding.begin(), sm_decoding.end(), job));
+		sm_decoded.push_back(job);
+	}
+}
+
+void TextureLoader::update(float budgetSeconds) {
+
+	double start = glfwGetTime();
+
+	while (true) {
+
+		Job* job = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(sm_mutex);
+			if (sm_decoded.empty())
+				break;
+			job = sm_decoded.front();
+			sm_decoded.pop_front();
+		}
+
+		// textures are only deleted on this thread, so a decoded job's texture can't change from here on
+		Texture* texture = job->texture;
+		if (texture == nullptr) {
+			if (job->pixels != nullptr)
+				Texture::freePixels(job->pixels);
+			delete job;
+			continue;
+		}
+
+		texture->m_loading = false;
+
+		if (job->pixels == nullptr) {
+			printf("Error: Failed to load texture %s\n", job->filename.c_str());
+			delete job;
+			continue;
+		}
+
+		// the pixels are copied into the buffer, and GL copies them into the texture without the frame
+		// waiting for it. orphaning the buffer lets the driver keep reading the last upload from the old storage
+		size_t size = (size_t)job->width * job->height * job->components;
+		if (sm_pixelBuffer == 0)
+			glGenBuffers(1, &sm_pixelBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sm_pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+		void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped != nullptr) {
+			memcpy(mapped, job->pixels, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		texture->createFromPixels(job->filename.c_str(), job->pixels, job->width, job->height, job->components,
+								  mapped != nullptr);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		delete job;
+
+		if (glfwGetTime() - start >= budgetSeconds)
+			break;
+	}
+}
+
+unsigned int TextureLoader::getPendingCount() {
+	std::lock_guard<std::mutex> lock(sm_mutex);
+	return (unsigned int)(sm_queued.size() + sm_decoding.size() + sm_decoded.size());
+}
+
+void TextureLoader::cancel(Texture* texture) {
+
+	// the job is freed by whichever thread next picks it up
+	std::lock_guard<std::mutex> lock(sm_mutex);
+	for (auto job : sm_queued)
+		if (job->texture == texture)
+			job->texture = nullptr;
+	for (auto job : sm_decoding)
+		if (job->texture == texture)
+			job->texture = nullptr;
+	for (auto job : sm_decoded)
+		if (job->texture == texture)
+			job->texture = nullptr;
+}
+
+void TextureLoader::destroy() {
+
+	{
+		std::lock_guard<std::mutex> lock(sm_mutex);
+		sm_quit = true;
+	}
+	sm_condition.notify_all();
+
+	for (auto& worker : sm_workers)
+		worker.join();
+	sm_workers.clear();
+
+	// the workers have stopped, so every job is in one of the lists
+	for (auto job : sm_queued) {
+		if (job->texture != nullptr)
+			job->texture->m_loading = false;
+		delete job;
+	}
+	for (auto job : sm_decoded) {
+		if (job->texture != nullptr)
+			job->texture->m_loading = false;
+		if (job->pixels != nullptr)
+			Texture::freePixels(job->pixels);
+		delete job;
+	}
+	sm_queued.clear();
+	sm_decoded.clear();
+
+	if (sm_pixelBuffer != 0) {
+		glDeleteBuffers(1, &sm_pixelBuffer);
+		sm_pixelBuffer = 0;
+	}
+}
+
+} // namespace aie
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace aie {
+
+class Texture;
+
+// loads textures without stalling the frame. images are decoded on worker threads, then update() uploads
+// them through a pixel unpack buffer on the GL thread, spending no more than a time budget each frame.
+// until a texture has loaded its handle is 0, and Renderer2D draws the plain white texture in its place
+class TextureLoader {
+public:
+
+	// returns a texture that will load in the background. it can be drawn and deleted straight away
+	static Texture*		load(const char* filename);
+
+	// loads an image into an existing texture in the background, which keeps its current image until then
+	static void			load(Texture* texture, const char* filename);
+
+	// uploads decoded textures until the budget is spent, always uploading at least one if any are ready.
+	// Application calls this at the start of every frame
+	static void			update(float budgetSeconds = 0.002f);
+
+	// the number of textures still decoding or waiting to upload
+	static unsigned int	getPendingCount();
+
+	// stops the workers and frees anything that hasn't loaded. Application calls this before closing the window
+	static void			destroy();
+
+private:
+
+	friend class Texture;
+
+	struct Job {
+		Texture*		texture;	// nullptr once the texture is deleted before it loads
+		std::string		filename;
+		unsigned char*	pixels;
+		int				width, height, components;
+	};
+
+	// forgets a texture that is deleted or reloaded before it finishes loading
+	static void			cancel(Texture* texture);
+
+	static void			work();
+
+	static std::vector<std::thread>	sm_workers;
+	static std::mutex				sm_mutex;
+	static std::condition_variable	sm_condition;
+	static bool						sm_quit;
+
+	// jobs waiting for a worker, being decoded, and decoded and waiting to upload
+	static std::deque<Job*>			sm_queued;
+	static std::vector<Job*>		sm_decoding;
+	static std::deque<Job*>			sm_decoded;
+
+	static unsigned int				sm_pixelBuffer;
+};
+
+} // namespace aie
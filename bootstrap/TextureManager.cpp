@@ -0,0 +1,112 @@
+#include "TextureManager.h"
+#include "TextureLoader.h"
+#include "Texture.h"
+#include "TextureAtlas.h"
+#include <algorithm>
+
+namespace aie {
+
+std::vector<Texture*> TextureManager::sm_textures;
+std::vector<TextureAtlas*> TextureManager::sm_atlases;
+size_t TextureManager::sm_budget = 512 * 1024 * 1024;
+unsigned int TextureManager::sm_frame = 1;
+
+void TextureManager::add(Texture* texture) {
+	sm_textures.push_back(texture);
+}
+
+void TextureManager::remove(Texture* texture) {
+	auto iter = std::find(sm_textures.begin(), sm_textures.end(), texture);
+	if (iter != sm_textures.end()) {
+		*iter = sm_textures.back();
+		sm_textures.pop_back();
+	}
+
+	for (auto atlas : sm_atlases)
+		atlas->remove(texture);
+}
+
+void TextureManager::addAtlas(TextureAtlas* atlas) {
+	sm_atlases.push_back(atlas);
+}
+
+void TextureManager::removeAtlas(TextureAtlas* atlas) {
+	auto iter = std::find(sm_atlases.begin(), sm_atlases.end(), atlas);
+	if (iter != sm_atlases.end()) {
+		*iter = sm_atlases.back();
+		sm_atlases.pop_back();
+	}
+}
+
+size_t TextureManager::getGPUBytes() {
+	size_t bytes = 0;
+	for (auto texture : sm_textures)
+		bytes += texture->getGPUBytes();
+	return bytes;
+}
+
+size_t TextureManager::getCPUBytes() {
+	size_t bytes = 0;
+	for (auto texture : sm_textures)
+		bytes += texture->getCPUBytes();
+	return bytes;
+}
+
+void TextureManager::touch(const Texture* texture) {
+
+	texture->m_lastUsed = sm_frame;
+
+	// loading the image back only restores what eviction freed, so the texture is the same to its users
+	if (texture->m_evicted) {
+		texture->m_evicted = false;
+		TextureLoader::load(const_cast<Texture*>(texture), texture->m_filename.c_str());
+	}
+}
+
+void TextureManager::update() {
+
+	sm_frame++;
+
+	size_t bytes = getGPUBytes();
+	if (bytes <= sm_budget)
+		return;
+
+	// textures that can be loaded again, least recently used first. anything used last frame
+	// is likely to be drawn again this frame, so evicting it would only load it straight back
+	std::vector<Texture*> candidates;
+	for (auto texture : sm_textures) {
+		if (texture->m_filename != "none" &&
+			texture->m_glHandle != 0 &&
+			texture->m_loading == false &&
+			texture->m_lastUsed + 1 < sm_frame)
+			candidates.push_back(texture);
+	}
+	std::sort(candidates.begin(), candidates.end(),
+			  [](const Texture* a, const Texture* b) { return a->m_lastUsed < b->m_lastUsed; });
+
+	for (auto texture : candidates) {
+		if (bytes <= sm_budget)
+			break;
+		bytes -= texture->getGPUBytes();
+		evict(texture);
+	}
+}
+
+void TextureManager::evict(Texture* texture) {
+
+	// the texture keeps its filename and size, so it still draws at the right size while it loads again
+	std::string filename = texture->m_filename;
+	unsigned int width = texture->m_width;
+	unsigned int height = texture->m_height;
+	unsigned int format = texture->m_format;
+
+	texture->release();
+
+	texture->m_filename = filename;
+	texture->m_width = width;
+	texture->m_height = height;
+	texture->m_format = format;
+	texture->m_evicted = true;
+}
+
+} // namespace aie
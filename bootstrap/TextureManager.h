@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace aie {
+
+class Texture;
+class TextureAtlas;
+
+// keeps track of how much memory every texture uses, and keeps the textures on the GPU within a budget.
+// once they go over it the textures that were bound longest ago are evicted, freeing their GL texture,
+// until they fit again. only textures loaded from a file can be evicted, and an evicted texture loads
+// again through TextureLoader and the asset cache the next time it is drawn or bound
+class TextureManager {
+public:
+
+	// the most bytes of texture memory to keep on the GPU, 512MB by default
+	static void		setBudget(size_t bytes) { sm_budget = bytes; }
+	static size_t	getBudget() { return sm_budget; }
+
+	// the bytes used on the GPU, including mipmaps, and by pixels kept on the CPU
+	static size_t	getGPUBytes();
+	static size_t	getCPUBytes();
+
+	// marks a texture as used this frame, and starts loading it again if it was evicted.
+	// Renderer2D and Texture::bind call this
+	static void		touch(const Texture* texture);
+
+	// evicts textures until the budget is met. Application calls this at the start of every frame
+	static void		update();
+
+private:
+
+	friend class Texture;
+	friend class TextureAtlas;
+
+	// a texture being deleted is also removed from every atlas, as a new texture could be given its address
+	static void		add(Texture* texture);
+	static void		remove(Texture* texture);
+	static void		evict(Texture* texture);
+
+	static void		addAtlas(TextureAtlas* atlas);
+	static void		removeAtlas(TextureAtlas* atlas);
+
+	static std::vector<Texture*>		sm_textures;
+	static std::vector<TextureAtlas*>	sm_atlases;
+	static size_t					sm_budget;
+	static unsigned int				sm_frame;
+};
+
+} // namespace aie